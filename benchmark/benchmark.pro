@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Benchmark of the compressor module
+# usage : qte_benchmark --output results.json
+#
+#-------------------------------------------------
+
+QT       += core concurrent
+QT       -= gui
+
+TARGET = qte_benchmark
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+include(../compressor/compressor.pri)
+
+SOURCES += main.cpp \
+    corpus_generator.cpp \
+    peak_memory.cpp
+
+HEADERS += corpus_generator.hpp \
+    peak_memory.hpp
+
+win32:LIBS += -lpsapi
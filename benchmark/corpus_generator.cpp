@@ -0,0 +1,200 @@
+#include "corpus_generator.hpp"
+
+#include <QDir>
+#include <QFile>
+
+#include <algorithm>
+#include <random>
+
+namespace qte{
+
+namespace bench{
+
+namespace{
+
+QByteArray random_data(std::mt19937 &engine, qint64 size)
+{
+    QByteArray data(static_cast<int>(size), Qt::Uninitialized);
+    for(int i = 0; i != data.size(); ++i){
+        data[i] = static_cast<char>(engine() & 0xFF);
+    }
+
+    return data;
+}
+
+QByteArray text_data(std::mt19937 &engine, qint64 size)
+{
+    static char const *const words[] = {
+        "the", "of", "and", "to", "in", "is", "that", "for", "it", "as",
+        "was", "with", "be", "by", "on", "not", "he", "this", "are", "or",
+        "his", "from", "at", "which", "but", "have", "an", "had", "they", "you",
+        "were", "their", "one", "all", "we", "can", "her", "has", "there", "been",
+        "compression", "archive", "folder", "thread", "block", "stream", "index",
+        "checksum", "network", "download", "memory", "benchmark", "throughput",
+        "latency", "schedule", "priority", "bandwidth", "request", "response",
+        "buffer", "queue", "signal", "slot", "device"
+    };
+    int const word_count = sizeof(words) / sizeof(words[0]);
+
+    QByteArray data;
+    data.reserve(static_cast<int>(size) + 64);
+    int line_words = 0;
+    while(data.size() < size){
+        //the smaller of two picks, the common words appear more often
+        int const index = static_cast<int>(std::min(engine() % word_count,
+                                                    engine() % word_count));
+        data += words[index];
+        if(++line_words == 12){
+            data += ".\n";
+            line_words = 0;
+        }else{
+            data += ' ';
+        }
+    }
+    data.resize(static_cast<int>(size));
+
+    return data;
+}
+
+}
+
+corpus_generator::corpus_generator(QString const &folder, qint64 size, quint32 seed) :
+    folder_(folder),
+    seed_(seed),
+    size_(size)
+{
+}
+
+bool corpus_generator::generate(std::vector<corpus> &corpora) const
+{
+    corpora.clear();
+    corpora.resize(5);
+
+    return text(corpora[0]) && random(corpora[1]) && images(corpora[2]) &&
+            many_small_files(corpora[3]) && few_huge_files(corpora[4]);
+}
+
+bool corpus_generator::few_huge_files(corpus &result) const
+{
+    if(!prepare("few_huge_files", result)){
+        return false;
+    }
+
+    //1MB chunks of text and random data alternately
+    std::mt19937 engine(seed_ + 5);
+    qint64 const chunk_size = 1024 * 1024;
+    for(int i = 0; i != 2; ++i){
+        QFile file(result.folder_ + QString("/huge_%1.bin").arg(i));
+        if(!file.open(QIODevice::WriteOnly)){
+            return false;
+        }
+        for(qint64 written = 0; written < size_ / 2; written += chunk_size){
+            qint64 const size = std::min(chunk_size, size_ / 2 - written);
+            QByteArray const chunk = (written / chunk_size) % 2 == 0 ?
+                        text_data(engine, size) : random_data(engine, size);
+            if(file.write(chunk) != chunk.size()){
+                return false;
+            }
+        }
+        result.files_.push_back(file.fileName());
+        result.size_ += file.size();
+    }
+
+    return true;
+}
+
+bool corpus_generator::images(corpus &result) const
+{
+    if(!prepare("images", result)){
+        return false;
+    }
+
+    std::mt19937 engine(seed_ + 3);
+    int const image_count = 16;
+    int const width = 512;
+    int const height = std::max<int>(1, static_cast<int>(size_ / (image_count * width * 3)));
+    for(int i = 0; i != image_count; ++i){
+        QByteArray data = QString("P6\n%1 %2\n255\n").arg(width).arg(height).toLatin1();
+        data.reserve(data.size() + width * height * 3);
+        for(int y = 0; y != height; ++y){
+            for(int x = 0; x != width; ++x){
+                int const noise = static_cast<int>(engine() % 16);
+                data += static_cast<char>((x + i * 16 + noise) & 0xFF);
+                data += static_cast<char>((y + noise) & 0xFF);
+                data += static_cast<char>(((x + y) / 2 + noise) & 0xFF);
+            }
+        }
+        if(!write_file(result.folder_ + QString("/image_%1.ppm").arg(i), data, result)){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool corpus_generator::many_small_files(corpus &result) const
+{
+    if(!prepare("many_small_files", result)){
+        return false;
+    }
+
+    std::mt19937 engine(seed_ + 4);
+    for(int i = 0; result.size_ < size_; ++i){
+        //100 files per folder
+        QString const folder = result.folder_ + QString("/dir_%1").arg(i / 100);
+        if(i % 100 == 0 && !QDir().mkpath(folder)){
+            return false;
+        }
+        qint64 const size = 512 + engine() % (8 * 1024 - 512);
+        if(!write_file(folder + QString("/file_%1.txt").arg(i),
+                       text_data(engine, size), result)){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool corpus_generator::random(corpus &result) const
+{
+    std::mt19937 engine(seed_ + 2);
+    return prepare("random", result) &&
+            write_file(result.folder_ + "/random.bin", random_data(engine, size_), result);
+}
+
+bool corpus_generator::text(corpus &result) const
+{
+    std::mt19937 engine(seed_ + 1);
+    return prepare("text", result) &&
+            write_file(result.folder_ + "/text.txt", text_data(engine, size_), result);
+}
+
+bool corpus_generator::prepare(QString const &name, corpus &result) const
+{
+    result = corpus();
+    result.name_ = name;
+    result.folder_ = folder_ + "/" + name;
+    QDir dir(result.folder_);
+    if(dir.exists() && !dir.removeRecursively()){
+        return false;
+    }
+
+    return QDir().mkpath(result.folder_);
+}
+
+bool corpus_generator::write_file(QString const &path, QByteArray const &data,
+                                  corpus &result) const
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()){
+        return false;
+    }
+    result.files_.push_back(path);
+    result.size_ += data.size();
+
+    return true;
+}
+
+}
+
+}
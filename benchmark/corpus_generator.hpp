@@ -0,0 +1,71 @@
+#ifndef QTE_BENCH_CORPUS_GENERATOR_HPP
+#define QTE_BENCH_CORPUS_GENERATOR_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include <vector>
+
+namespace qte{
+
+namespace bench{
+
+/**
+ * A folder of generated files
+ */
+struct corpus
+{
+    QStringList files_; //absolute paths of the files
+    QString folder_;
+    QString name_;
+    qint64 size_ = 0; //total bytes of the files
+};
+
+/**
+ * Generate the corpora of the benchmark. The content only depend on
+ * the seed and the size, so the results of different builds or
+ * machines can be compared. std::mt19937 is used directly since the
+ * distributions of the standard library are not portable
+ */
+class corpus_generator
+{
+public:
+    /**
+     * @param folder where to save the corpora
+     * @param size approximate bytes of every corpus
+     * @param seed seed of the random engine
+     */
+    corpus_generator(QString const &folder, qint64 size, quint32 seed = 2016);
+
+    /**
+     * Generate all of the corpora
+     * @return true if success and vice versa
+     */
+    bool generate(std::vector<corpus> &corpora) const;
+
+    //two huge files mixing text and random data
+    bool few_huge_files(corpus &result) const;
+    //uncompressed PPM images of gradient with noise
+    bool images(corpus &result) const;
+    //text files of 512 bytes to 8KB inside sub folders
+    bool many_small_files(corpus &result) const;
+    //one file of incompressible data
+    bool random(corpus &result) const;
+    //one file of english like text
+    bool text(corpus &result) const;
+
+private:
+    bool prepare(QString const &name, corpus &result) const;
+    bool write_file(QString const &path, QByteArray const &data,
+                    corpus &result) const;
+
+    QString folder_;
+    quint32 seed_;
+    qint64 size_;
+};
+
+}
+
+}
+
+#endif // QTE_BENCH_CORPUS_GENERATOR_HPP
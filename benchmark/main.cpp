@@ -0,0 +1,248 @@
+#include "corpus_generator.hpp"
+#include "peak_memory.hpp"
+
+#include "../compressor/checksum.hpp"
+#include "../compressor/codec.hpp"
+#include "../compressor/file_compressor.hpp"
+#include "../compressor/folder_compressor.hpp"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+using namespace qte;
+
+namespace{
+
+struct measure
+{
+    qint64 peak_rss_kb_ = -1;
+    double seconds_ = 0;
+    bool success_ = false;
+};
+
+//Run the function repeat times, keep the fastest run
+measure run(std::function<bool()> const &func, int repeat)
+{
+    measure best;
+    for(int i = 0; i != repeat; ++i){
+        //without reset the peak belong to the whole process rather
+        //than this case, report it as unknown
+        bool const peak_reset = bench::reset_peak_rss();
+        QElapsedTimer timer;
+        timer.start();
+        bool const success = func();
+        double const seconds = timer.nsecsElapsed() / 1e9;
+        if(!success){
+            return {};
+        }
+        if(i == 0 || seconds < best.seconds_){
+            best.peak_rss_kb_ = peak_reset ? bench::peak_rss_kb() : -1;
+            best.seconds_ = seconds;
+        }
+        best.success_ = true;
+    }
+
+    return best;
+}
+
+double mb_per_second(qint64 bytes, double seconds)
+{
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+qint64 folder_size(QString const &folder)
+{
+    qint64 size = 0;
+    QDir const dir(folder);
+    for(auto const &info : dir.entryInfoList(QDir::NoDotAndDotDot | QDir::Dirs | QDir::Files)){
+        size += info.isDir() ? folder_size(info.absoluteFilePath()) : info.size();
+    }
+
+    return size;
+}
+
+std::vector<int> parse_list(QString const &value)
+{
+    std::vector<int> result;
+    for(auto const &item : value.split(',', Qt::SkipEmptyParts)){
+        result.push_back(item.trimmed().toInt());
+    }
+
+    return result;
+}
+
+QString codec_name(cp::codec_id id)
+{
+    switch(id){
+    case cp::codec_id::lz4 : return "lz4";
+    case cp::codec_id::zstd : return "zstd";
+    default : return "zlib";
+    }
+}
+
+QJsonObject make_result(QString const &api, bench::corpus const &corpus,
+                        cp::codec_id codec, int level, int threads,
+                        qint64 compressed_size, measure const &compress,
+                        measure const &decompress)
+{
+    QJsonObject result;
+    result["api"] = api;
+    result["codec"] = codec_name(codec);
+    result["compressed_bytes"] = compressed_size;
+    result["compress_mb_per_s"] = mb_per_second(corpus.size_, compress.seconds_);
+    result["compress_peak_rss_kb"] = compress.peak_rss_kb_;
+    result["corpus"] = corpus.name_;
+    result["decompress_mb_per_s"] = mb_per_second(corpus.size_, decompress.seconds_);
+    result["decompress_peak_rss_kb"] = decompress.peak_rss_kb_;
+    result["level"] = level;
+    result["ratio"] = corpus.size_ > 0 ? static_cast<double>(compressed_size) / corpus.size_ : 0;
+    result["raw_bytes"] = corpus.size_;
+    result["success"] = compress.success_ && decompress.success_;
+    result["threads"] = threads;
+
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qte_benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark of the compressor module");
+    parser.addHelpOption();
+    QCommandLineOption const output_option("output", "Where to save the results(json)",
+                                           "file", "benchmark_results.json");
+    QCommandLineOption const work_option("work-dir", "Where to generate the corpora",
+                                         "folder", QDir::tempPath() + "/qte_benchmark");
+    QCommandLineOption const size_option("size-mb", "Size of every corpus in MB",
+                                         "size", "64");
+    QCommandLineOption const seed_option("seed", "Seed of the corpora", "seed", "2016");
+    QCommandLineOption const levels_option("levels", "Compression levels, comma separated",
+                                           "levels", "1,2,3,4,5,6,7,8,9");
+    QCommandLineOption const threads_option("threads", "Thread counts, comma separated, "
+                                            "default is powers of 2 up to the cores",
+                                            "threads");
+    QCommandLineOption const repeat_option("repeat", "Run every case n times and keep "
+                                           "the fastest", "n", "1");
+    parser.addOptions({output_option, work_option, size_option, seed_option,
+                       levels_option, threads_option, repeat_option});
+    parser.process(app);
+
+    std::vector<int> const levels = parse_list(parser.value(levels_option));
+    std::vector<int> threads = parse_list(parser.value(threads_option));
+    if(threads.empty()){
+        int const ideal = std::max(1, QThread::idealThreadCount());
+        for(int i = 1; i < ideal; i *= 2){
+            threads.push_back(i);
+        }
+        threads.push_back(ideal);
+    }
+    int const repeat = std::max(1, parser.value(repeat_option).toInt());
+    qint64 const size = parser.value(size_option).toLongLong() * 1024 * 1024;
+    quint32 const seed = parser.value(seed_option).toUInt();
+    QString const work_dir = parser.value(work_option);
+
+    QTextStream out(stdout);
+    out<<"generating corpora under "<<work_dir<<Qt::endl;
+    std::vector<bench::corpus> corpora;
+    if(!bench::corpus_generator(work_dir + "/corpora", size, seed).generate(corpora)){
+        out<<"cannot generate the corpora"<<Qt::endl;
+        return -1;
+    }
+
+    QString const compressed = work_dir + "/compressed";
+    QString const restored = work_dir + "/restored";
+    QJsonArray results;
+    for(auto const &corpus : corpora){
+        for(auto const codec : cp::available_codecs()){
+            for(int const level : levels){
+                for(int const thread_count : threads){
+                    //the stream api compress one file
+                    if(corpus.files_.size() == 1){
+                        QString const source = corpus.files_.front();
+                        measure const compress = run([&]()
+                        {
+                            return cp::compress(source, compressed, level,
+                                                1024 * 1024, thread_count, codec);
+                        }, repeat);
+                        qint64 const compressed_size = QFileInfo(compressed).size();
+                        measure const decompress = run([&]()
+                        {
+                            return cp::decompress(compressed, restored, thread_count) &&
+                                    QFileInfo(restored).size() == corpus.size_;
+                        }, repeat);
+                        results.push_back(make_result("file", corpus, codec, level, thread_count,
+                                                      compressed_size, compress, decompress));
+                        QFile::remove(restored);
+                    }
+
+                    cp::folder_compressor folder;
+                    folder.set_codec(codec);
+                    folder.set_thread_count(thread_count);
+                    measure const compress = run([&]()
+                    {
+                        return folder.compress_folder(corpus.folder_, compressed, level);
+                    }, repeat);
+                    qint64 const compressed_size = QFileInfo(compressed).size();
+                    measure const decompress = run([&]()
+                    {
+                        QDir(restored).removeRecursively();
+                        return folder.decompress_folder(compressed, restored) &&
+                                folder_size(restored) == corpus.size_;
+                    }, repeat);
+                    results.push_back(make_result("folder", corpus, codec, level, thread_count,
+                                                  compressed_size, compress, decompress));
+                    QDir(restored).removeRecursively();
+
+                    auto const last = results.last().toObject();
+                    out<<corpus.name_<<" "<<codec_name(codec)<<" level "<<level
+                      <<" threads "<<thread_count<<" ratio "<<last["ratio"].toDouble()
+                      <<" compress "<<last["compress_mb_per_s"].toDouble()<<"MB/s"
+                      <<" decompress "<<last["decompress_mb_per_s"].toDouble()<<"MB/s"<<Qt::endl;
+                }
+            }
+        }
+    }
+    QFile::remove(compressed);
+
+    QJsonObject environment;
+    environment["cpu"] = QSysInfo::currentCpuArchitecture();
+    environment["crc32c_hardware"] = cp::crc32c_hardware_accelerated();
+    environment["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    environment["ideal_thread_count"] = QThread::idealThreadCount();
+    environment["os"] = QSysInfo::prettyProductName();
+    environment["qt"] = qVersion();
+    environment["repeat"] = repeat;
+    environment["seed"] = static_cast<qint64>(seed);
+    environment["size_mb"] = size / (1024 * 1024);
+
+    QJsonObject report;
+    report["environment"] = environment;
+    report["results"] = results;
+    QFile output(parser.value(output_option));
+    if(!output.open(QIODevice::WriteOnly) ||
+            output.write(QJsonDocument(report).toJson()) < 0){
+        out<<"cannot write "<<output.fileName()<<Qt::endl;
+        return -1;
+    }
+    out<<"results are saved to "<<output.fileName()<<Qt::endl;
+
+    return 0;
+}
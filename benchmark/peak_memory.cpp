@@ -0,0 +1,62 @@
+#include "peak_memory.hpp"
+
+#include <QFile>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace qte{
+
+namespace bench{
+
+qint64 peak_rss_kb()
+{
+#if defined(Q_OS_LINUX)
+    //VmHWM is reset by clear_refs, ru_maxrss is not
+    QFile status("/proc/self/status");
+    if(status.open(QIODevice::ReadOnly)){
+        for(QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()){
+            if(line.startsWith("VmHWM:")){
+                return line.mid(6).trimmed().split(' ').front().toLongLong();
+            }
+        }
+    }
+    return -1;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+        return static_cast<qint64>(counters.PeakWorkingSetSize / 1024);
+    }
+    return -1;
+#elif defined(Q_OS_UNIX)
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0){
+#ifdef Q_OS_MACOS
+        return usage.ru_maxrss / 1024; //bytes on mac
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+    return -1;
+#else
+    return -1;
+#endif
+}
+
+bool reset_peak_rss()
+{
+#ifdef Q_OS_LINUX
+    QFile clear_refs("/proc/self/clear_refs");
+    return clear_refs.open(QIODevice::WriteOnly) && clear_refs.write("5") == 1;
+#else
+    return false;
+#endif
+}
+
+}
+
+}
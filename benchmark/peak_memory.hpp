@@ -0,0 +1,27 @@
+#ifndef QTE_BENCH_PEAK_MEMORY_HPP
+#define QTE_BENCH_PEAK_MEMORY_HPP
+
+#include <QtGlobal>
+
+namespace qte{
+
+namespace bench{
+
+/**
+ * @return peak resident set size of the process in KB, -1 if unknown
+ */
+qint64 peak_rss_kb();
+
+/**
+ * Reset the peak resident set size, so every case of the benchmark
+ * can be measured by itself. Only supported on linux, the peak of
+ * other platforms is the peak since the process start
+ * @return true if the peak is reset
+ */
+bool reset_peak_rss();
+
+}
+
+}
+
+#endif // QTE_BENCH_PEAK_MEMORY_HPP
@@ -0,0 +1,135 @@
+#include "adaptive_level.hpp"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <limits>
+
+namespace qte{
+
+namespace cp{
+
+adaptive_level::adaptive_level(int min_level, int max_level) :
+    deadline_(0),
+    done_bytes_(0),
+    level_(1),
+    max_level_(1),
+    min_level_(1),
+    requested_max_level_(std::max(0, max_level)),
+    requested_min_level_(std::max(0, min_level)),
+    speed_(1, 0),
+    target_(0),
+    thread_count_(1),
+    total_bytes_(0)
+{
+}
+
+int adaptive_level::level() const
+{
+    QMutexLocker lock(&mutex_);
+    return level_;
+}
+
+void adaptive_level::report(int level, qint64 raw_bytes, qint64 nsecs)
+{
+    QMutexLocker lock(&mutex_);
+    done_bytes_ += raw_bytes;
+    if(level >= min_level_ && level <= max_level_ && raw_bytes > 0 && nsecs > 0){
+        //moving average, the speed change with the data
+        double const speed = static_cast<double>(raw_bytes) / nsecs;
+        double &average = speed_[static_cast<size_t>(level - min_level_)];
+        average = average == 0 ? speed : average * 0.7 + speed * 0.3;
+    }
+    select_level();
+}
+
+void adaptive_level::set_deadline(qint64 msec)
+{
+    QMutexLocker lock(&mutex_);
+    deadline_ = msec;
+}
+
+void adaptive_level::set_target_throughput(double mb_per_second)
+{
+    QMutexLocker lock(&mutex_);
+    target_ = mb_per_second * 1024 * 1024 / 1e9;
+}
+
+void adaptive_level::start(qint64 total_bytes, int thread_count, int codec_max_level)
+{
+    QMutexLocker lock(&mutex_);
+    //zlib use 1~9, lz4 use 1~12 and zstd use 1~22, the range given by
+    //the user is narrowed to the codec
+    codec_max_level = std::max(1, codec_max_level);
+    int const min_level = requested_min_level_ > 0 ?
+                std::min(requested_min_level_, codec_max_level) : 1;
+    int const max_level = requested_max_level_ > 0 ?
+                std::max(min_level, std::min(requested_max_level_, codec_max_level)) :
+                codec_max_level;
+    if(min_level != min_level_ || max_level != max_level_){
+        min_level_ = min_level;
+        max_level_ = max_level;
+        speed_.assign(static_cast<size_t>(max_level_ - min_level_ + 1), 0);
+    }
+    done_bytes_ = 0;
+    elapsed_.start();
+    thread_count_ = std::max(1, thread_count);
+    total_bytes_ = total_bytes;
+    if(deadline_ <= 0 && target_ <= 0){
+        level_ = max_level_;
+    }else if(std::all_of(std::begin(speed_), std::end(speed_), [](double v){ return v == 0; })){
+        //nothing is measured yet, begin from the middle
+        level_ = (min_level_ + max_level_) / 2;
+    }else{
+        select_level();
+    }
+}
+
+double adaptive_level::required_speed() const
+{
+    double required = target_;
+    if(deadline_ > 0){
+        qint64 const remain_msec = deadline_ - elapsed_.elapsed();
+        qint64 const remain_bytes = std::max<qint64>(0, total_bytes_ - done_bytes_);
+        if(remain_msec <= 0){
+            return remain_bytes > 0 ? std::numeric_limits<double>::max() : 0;
+        }
+        required = std::max(required, static_cast<double>(remain_bytes) / (remain_msec * 1e6));
+    }
+
+    return required / thread_count_;
+}
+
+void adaptive_level::select_level()
+{
+    double const required = required_speed();
+    if(required <= 0){
+        level_ = max_level_;
+        return;
+    }
+
+    //higher level is assumed to be slower, so the unknown level below a
+    //measured level is at least as fast as it. Pick the highest level
+    //fast enough, the level above it is tried if there are enough margin
+    int best = min_level_;
+    double best_speed = 0;
+    double known_speed = 0;
+    for(int level = max_level_; level >= min_level_; --level){
+        double const measured = speed_[static_cast<size_t>(level - min_level_)];
+        known_speed = std::max(known_speed, measured);
+        if(known_speed > 0 && known_speed >= required){
+            best = level;
+            best_speed = known_speed;
+            break;
+        }
+    }
+    if(best < max_level_ && speed_[static_cast<size_t>(best + 1 - min_level_)] == 0 &&
+            best_speed >= required * 1.5){
+        ++best;
+    }
+    level_ = best;
+}
+
+}
+
+}
@@ -0,0 +1,91 @@
+#ifndef QTE_CP_ADAPTIVE_LEVEL_HPP
+#define QTE_CP_ADAPTIVE_LEVEL_HPP
+
+#include <QElapsedTimer>
+#include <QMutex>
+
+#include <vector>
+
+namespace qte{
+
+namespace cp{
+
+/**
+ * Choose the compression level of every block or entry by the measured
+ * throughput, so the compression meet the throughput or deadline target
+ * with the best ratio it can. The compressor call start() once, level()
+ * before compressing a block and report() after that, the functions are
+ * thread safe. Without target the max level is used
+ */
+class adaptive_level
+{
+public:
+    /**
+     * @param min_level the lowest level may be used, 0 means the lowest
+     * level of the codec
+     * @param max_level the highest level may be used, 0 means the highest
+     * level of the codec. The range is narrowed to the levels of the codec
+     * when the compression begin
+     */
+    explicit adaptive_level(int min_level = 0, int max_level = 0);
+
+    /**
+     * @return level of the next block or entry
+     */
+    int level() const;
+
+    /**
+     * Record the time spent on compressing a block or an entry
+     * @param level level used by the block
+     * @param raw_bytes size of the uncompressed data
+     * @param nsecs time spent on compression
+     */
+    void report(int level, qint64 raw_bytes, qint64 nsecs);
+
+    /**
+     * Finish the compression within msec after start(), 0 means no deadline
+     */
+    void set_deadline(qint64 msec);
+
+    /**
+     * Compress at least mb_per_second MB of uncompressed data per second,
+     * 0 means no target
+     */
+    void set_target_throughput(double mb_per_second);
+
+    /**
+     * Called by the compressor when the compression begin, the measured
+     * speed of every level is kept, so the object can be reused by
+     * similar jobs
+     * @param total_bytes uncompressed bytes going to be compressed
+     * @param thread_count number of threads compress concurrently
+     * @param codec_max_level the highest level of the codec, the measured
+     * speed is discarded if the range of level change
+     */
+    void start(qint64 total_bytes, int thread_count, int codec_max_level);
+
+private:
+    //bytes per nanosecond one thread need to reach
+    double required_speed() const;
+    void select_level();
+
+    qint64 deadline_;
+    qint64 done_bytes_;
+    QElapsedTimer elapsed_;
+    int level_;
+    int max_level_;
+    int min_level_;
+    mutable QMutex mutex_;
+    int requested_max_level_; //0 if it is the highest level of codec
+    int requested_min_level_; //0 if it is the lowest level of codec
+    std::vector<double> speed_; //bytes per nanosecond of every level, 0 if unknown
+    double target_; //bytes per nanosecond
+    int thread_count_;
+    qint64 total_bytes_;
+};
+
+}
+
+}
+
+#endif // QTE_CP_ADAPTIVE_LEVEL_HPP
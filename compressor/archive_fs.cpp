@@ -0,0 +1,275 @@
+#include "archive_fs.hpp"
+#include "checksum.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <set>
+
+namespace qte{
+
+namespace cp{
+
+namespace{
+
+//Read the data of a file from the uncompressed block, the block is
+//shared with the cache and the other devices
+class entry_device : public QIODevice
+{
+public:
+    entry_device(std::shared_ptr<void> archive, QByteArray block,
+                 qint64 offset, qint64 size) :
+        archive_(std::move(archive)),
+        block_(std::move(block)),
+        offset_(offset),
+        size_(size)
+    {
+    }
+
+    bool isSequential() const override
+    {
+        return false;
+    }
+
+    qint64 size() const override
+    {
+        return size_;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        //the device is unbuffered, pos() is the position of the block
+        qint64 const size = std::max<qint64>(0, std::min(maxSize, size_ - pos()));
+        std::memcpy(data, block_.constData() + offset_ + pos(), static_cast<size_t>(size));
+        return size;
+    }
+
+    qint64 writeData(char const*, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    std::shared_ptr<void> archive_; //keep the mapped archive alive
+    QByteArray block_;
+    qint64 offset_;
+    qint64 size_;
+};
+
+QString normalize(QString const &path)
+{
+    QString const result = QDir::cleanPath("/" + QString(path).replace('\\', '/'));
+    return result.isEmpty() ? QString("/") : result;
+}
+
+//position of the data of the entry in the uncompressed block
+qint64 offset_in_block(archive_entry const &entry)
+{
+    return (entry.flags_ & entry_solid) ? entry.solid_offset_ : 0;
+}
+
+bool entry_intact(QByteArray const &block, archive_entry const &entry)
+{
+    qint64 const offset = offset_in_block(entry);
+    return offset >= 0 && offset + entry.raw_size_ <= block.size() &&
+            (!entry.has_checksum_ ||
+             crc32c(block.constData() + offset, entry.raw_size_) == entry.checksum_);
+}
+
+}
+
+struct archive_fs::shared_data
+{
+    //Get the uncompressed block of the entry from the cache, uncompress
+    //and put it into the cache if it is not there. The data of the entry
+    //is verified by the checksum once, the first time it is taken from
+    //the block, until the block leave the cache
+    bool load(archive_entry const &entry, QByteArray &unpacked);
+
+    struct cached_block
+    {
+        qint64 bytes_ = 0; //0 if the block refer to the mapped archive
+        QByteArray data_;
+        std::set<QString> verified_; //name of the entries verified
+    };
+
+    qint64 cache_bytes_ = 0;
+    qint64 cache_size_ = 0;
+    //offset of block -> position in lru_
+    std::map<qint64, std::list<std::pair<qint64, cached_block>>::iterator> blocks_;
+    QFile file_;
+    //most recently used block come first
+    std::list<std::pair<qint64, cached_block>> lru_;
+    uchar const *mapped_ = nullptr;
+    QMutex mutex_;
+};
+
+bool archive_fs::shared_data::load(archive_entry const &entry, QByteArray &unpacked)
+{
+    QByteArray packed;
+    bool cached = false;
+    {
+        QMutexLocker lock(&mutex_);
+        auto it = blocks_.find(entry.offset_);
+        if(it != std::end(blocks_)){
+            lru_.splice(std::begin(lru_), lru_, it->second);
+            cached_block const &block = it->second->second;
+            unpacked = block.data_;
+            if(block.verified_.find(entry.name_) != std::end(block.verified_)){
+                return true;
+            }
+            cached = true;
+        }else{
+            //the file is shared by the readers, only read it under the lock
+            packed = mapped_ ?
+                        QByteArray::fromRawData(reinterpret_cast<char const*>(mapped_ + entry.offset_),
+                                                static_cast<int>(entry.packed_size_)) :
+                        read_archive_entry(file_, entry);
+        }
+    }
+
+    //several readers may uncompress or verify the same block at the same
+    //time, it is cheaper than holding the lock while doing it
+    if((!cached && !unpack_entry_data(packed, entry, unpacked)) ||
+            !entry_intact(unpacked, entry)){
+        return false;
+    }
+
+    QMutexLocker lock(&mutex_);
+    auto it = blocks_.find(entry.offset_);
+    if(it == std::end(blocks_)){
+        cached_block block;
+        //the stored entry refer to the mapped archive, it cost no memory
+        block.bytes_ = (entry.flags_ & entry_stored) && mapped_ ? 0 : unpacked.size();
+        block.data_ = unpacked;
+        lru_.emplace_front(entry.offset_, std::move(block));
+        it = blocks_.emplace(entry.offset_, std::begin(lru_)).first;
+        cache_bytes_ += lru_.front().second.bytes_;
+    }
+    it->second->second.verified_.insert(entry.name_);
+    while(cache_bytes_ > cache_size_ && lru_.size() > 1){
+        cache_bytes_ -= lru_.back().second.bytes_;
+        blocks_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+
+    return true;
+}
+
+archive_fs::archive_fs(qint64 cache_size) :
+    cache_size_(cache_size)
+{
+}
+
+archive_fs::~archive_fs()
+{
+}
+
+void archive_fs::close()
+{
+    data_.reset();
+    files_.clear();
+    folders_.clear();
+}
+
+QStringList archive_fs::entry_list(QString const &folder) const
+{
+    QStringList result;
+    auto it = folders_.find(normalize(folder));
+    if(it != std::end(folders_)){
+        for(auto const &name : it->second){
+            result.push_back(name);
+        }
+    }
+
+    return result;
+}
+
+bool archive_fs::exists(QString const &path) const
+{
+    QString const name = normalize(path);
+    return files_.find(name) != std::end(files_) ||
+            folders_.find(name) != std::end(folders_);
+}
+
+bool archive_fs::is_dir(QString const &path) const
+{
+    return folders_.find(normalize(path)) != std::end(folders_);
+}
+
+bool archive_fs::open(QString const &archive_file)
+{
+    close();
+
+    std::shared_ptr<shared_data> data = std::make_shared<shared_data>();
+    data->cache_size_ = cache_size_;
+    data->file_.setFileName(archive_file);
+    std::vector<archive_entry> entries;
+    if(!data->file_.open(QIODevice::ReadOnly) ||
+            !read_archive_index(data->file_, entries)){
+        return false;
+    }
+    qint64 const size = data->file_.size();
+    if(size > 0 && static_cast<quint64>(size) <= std::numeric_limits<size_t>::max()){
+        data->mapped_ = data->file_.map(0, size);
+    }
+
+    //every ancestor of the files is a folder, stop at the folder
+    //already known since its ancestors are recorded
+    folders_["/"];
+    for(auto &entry : entries){
+        QString const name = normalize(entry.name_);
+        for(QString path = name; path != "/";){
+            int const separator = path.lastIndexOf('/');
+            QString const parent = separator > 0 ? path.left(separator) : QString("/");
+            bool const known = folders_.find(parent) != std::end(folders_);
+            folders_[parent].insert(path.mid(separator + 1));
+            if(known){
+                break;
+            }
+            path = parent;
+        }
+        files_[name] = std::move(entry);
+    }
+    data_ = std::move(data);
+
+    return true;
+}
+
+std::unique_ptr<QIODevice> archive_fs::open_file(QString const &path) const
+{
+    auto it = files_.find(normalize(path));
+    QByteArray block;
+    if(!data_ || it == std::end(files_) || !data_->load(it->second, block)){
+        return nullptr;
+    }
+
+    archive_entry const &entry = it->second;
+    std::unique_ptr<QIODevice> device(new entry_device(data_, block, offset_in_block(entry),
+                                                       entry.raw_size_));
+    device->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+    return device;
+}
+
+bool archive_fs::stat(QString const &path, archive_entry &entry) const
+{
+    auto it = files_.find(normalize(path));
+    if(it == std::end(files_)){
+        return false;
+    }
+    entry = it->second;
+
+    return true;
+}
+
+}
+
+}
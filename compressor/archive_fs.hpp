@@ -0,0 +1,84 @@
+#ifndef QTE_CP_ARCHIVE_FS_HPP
+#define QTE_CP_ARCHIVE_FS_HPP
+
+#include "archive_index.hpp"
+
+#include <QIODevice>
+#include <QStringList>
+
+#include <map>
+#include <memory>
+#include <set>
+
+namespace qte{
+
+namespace cp{
+
+/**
+ * Read only file system over the archive created by folder_compressor,
+ * the files can be read without extracting the archive. The uncompressed
+ * blocks are kept in a LRU cache shared by all of the opened files, so
+ * reading the files of the same solid block only uncompress it once.
+ * The paths are relative to the root of the archive, "/a/b.txt" and
+ * "a/b.txt" are the same file. The const functions are thread safe
+ */
+class archive_fs
+{
+public:
+    /**
+     * @param cache_size maximum bytes of the uncompressed blocks in the
+     * cache, the blocks still read by the opened files are released after
+     * the files are closed
+     */
+    explicit archive_fs(qint64 cache_size = 64 * 1024 * 1024);
+    ~archive_fs();
+
+    void close();
+
+    /**
+     * Names of the files and folders directly under the folder, sorted
+     * by name
+     * @param folder the folder, "/" or empty string is the root
+     */
+    QStringList entry_list(QString const &folder) const;
+
+    bool exists(QString const &path) const;
+
+    bool is_dir(QString const &path) const;
+
+    /**
+     * Open the archive, only the central directory is read
+     * @return true if success and vice versa
+     */
+    bool open(QString const &archive_file);
+
+    /**
+     * Open the file of the archive as read only device, the data is
+     * verified by the checksum when it is first opened, and again only
+     * if its block is uncompressed again after it leave the cache. The
+     * device keep the archive open, it can outlive this object
+     * @return opened device, nullptr if the file do not exist or the
+     * data is corrupted
+     */
+    std::unique_ptr<QIODevice> open_file(QString const &path) const;
+
+    /**
+     * Get the information(size, modified time, checksum etc) of the file
+     * @return false if the file do not exist
+     */
+    bool stat(QString const &path, archive_entry &entry) const;
+
+private:
+    struct shared_data;
+
+    qint64 cache_size_;
+    std::shared_ptr<shared_data> data_;
+    std::map<QString, std::set<QString>> folders_; //folder -> children
+    std::map<QString, archive_entry> files_;
+};
+
+}
+
+}
+
+#endif // QTE_CP_ARCHIVE_FS_HPP
@@ -0,0 +1,387 @@
+#include "archive_index.hpp"
+#include "checksum.hpp"
+
+#include <QDataStream>
+#include <QFileDevice>
+#include <QtEndian>
+
+#if defined(Q_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <limits>
+
+namespace qte{
+
+namespace cp{
+
+namespace{
+
+//Layout of the indexed archive
+//"QTEA" | version | compressed data of entries... | central directory | trailer
+//central directory : count | {name, offset, packed size, raw size, checksum, flags, codec,
+//                             solid offset, solid size, mtime}...
+//trailer : position of central directory | version of central directory | "QTEV"
+//The header keep the version the archive is created with, the directories
+//appended later may be newer. Before version 7 the trailer is
+//position of central directory | "QTED", in the version of the header
+quint32 const archive_magic = 0x51544541;
+quint32 const directory_magic = 0x51544544;
+quint32 const versioned_directory_magic = 0x51544556;
+//version 3 added the flags of entry, version 4 added the codec of entry,
+//version 5 added the solid block, version 6 added the modified time,
+//version 7 added the version of trailer
+quint16 const archive_version = 7;
+quint16 const versioned_trailer_version = 7;
+qint64 const archive_header_size = sizeof(quint32) + sizeof(quint16);
+qint64 const trailer_size = sizeof(quint64) + sizeof(quint32);
+qint64 const versioned_trailer_size = sizeof(quint64) + sizeof(quint16) + sizeof(quint32);
+//name(length of empty string), offset, packed size, raw size and
+//checksum, the smallest entry of any version
+quint64 const min_directory_entry_size = sizeof(quint32) + 3 * sizeof(quint64) + sizeof(quint32);
+//the data of an entry or a solid block is held by one QByteArray
+quint64 const max_entry_data_size = static_cast<quint64>(std::numeric_limits<int>::max());
+
+bool read_legacy_index(QIODevice &device, std::vector<archive_entry> &entries)
+{
+    //the old archive is a row of QString and QByteArray, the
+    //compressed data is prefixed by the size in QDataStream
+    device.seek(0);
+    QDataStream in(&device);
+    while(!in.atEnd()){
+        archive_entry entry;
+        quint32 packed_size = 0;
+        in>>entry.name_>>packed_size;
+        if(in.status() != QDataStream::Ok){
+            return false;
+        }
+        if(packed_size == 0xFFFFFFFF){//null QByteArray
+            packed_size = 0;
+        }
+        entry.offset_ = device.pos();
+        entry.packed_size_ = packed_size;
+        if(entry.offset_ + entry.packed_size_ > device.size()){
+            return false;
+        }
+        //qCompress store the uncompressed size in the first 4 bytes
+        if(packed_size >= sizeof(quint32)){
+            quint32 raw_size = 0;
+            in>>raw_size;
+            entry.raw_size_ = raw_size;
+        }
+        if(!device.seek(entry.offset_ + entry.packed_size_)){
+            return false;
+        }
+        entries.emplace_back(std::move(entry));
+    }
+
+    return true;
+}
+
+//Read the central directory at directory_offset, which must end where
+//the trailer begin
+bool read_directory(QIODevice &device, quint16 version, quint64 directory_offset,
+                    qint64 directory_end, std::vector<archive_entry> &entries)
+{
+    entries.clear();
+    if(directory_offset > static_cast<quint64>(directory_end) ||
+            !device.seek(static_cast<qint64>(directory_offset))){
+        return false;
+    }
+
+    //the count come from the file, do not trust it before it is
+    //checked against the size of the directory
+    QDataStream in(&device);
+    quint32 count = 0;
+    in>>count;
+    quint64 const directory_size = static_cast<quint64>(directory_end) - directory_offset;
+    if(in.status() != QDataStream::Ok || directory_size < sizeof(quint32) ||
+            count > (directory_size - sizeof(quint32)) / min_directory_entry_size){
+        return false;
+    }
+    entries.reserve(count);
+    for(quint32 i = 0; i != count; ++i){
+        archive_entry entry;
+        quint64 offset = 0, packed_size = 0, raw_size = 0;
+        quint64 solid_offset = 0, solid_size = 0;
+        in>>entry.name_>>offset>>packed_size>>raw_size>>entry.checksum_;
+        if(version >= 3){
+            in>>entry.flags_;
+        }
+        if(version >= 4){
+            quint8 id = 0;
+            in>>id;
+            entry.codec_ = static_cast<codec_id>(id);
+        }
+        if(version >= 5){
+            in>>solid_offset>>solid_size;
+        }
+        if(version >= 6){
+            in>>entry.mtime_;
+        }
+        //the sizes are casted to int when the data is read and unpacked
+        if(in.status() != QDataStream::Ok || offset > directory_offset ||
+                packed_size > directory_offset - offset ||
+                packed_size > max_entry_data_size || raw_size > max_entry_data_size ||
+                solid_offset > max_entry_data_size || solid_size > max_entry_data_size){
+            entries.clear();
+            return false;
+        }
+        entry.has_checksum_ = true;
+        entry.offset_ = static_cast<qint64>(offset);
+        entry.packed_size_ = static_cast<qint64>(packed_size);
+        entry.raw_size_ = static_cast<qint64>(raw_size);
+        entry.solid_offset_ = static_cast<qint64>(solid_offset);
+        entry.solid_size_ = static_cast<qint64>(solid_size);
+        entries.emplace_back(std::move(entry));
+    }
+    if(device.pos() != directory_end){
+        entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+//Read the central directory of the archive which end at archive_end,
+//header_version is the version in the header of the archive
+bool read_archive_end(QIODevice &device, quint16 header_version, qint64 archive_end,
+                      std::vector<archive_entry> &entries)
+{
+    if(archive_end < archive_header_size + trailer_size ||
+            !device.seek(archive_end - static_cast<qint64>(sizeof(quint32)))){
+        return false;
+    }
+
+    QDataStream in(&device);
+    quint32 magic = 0;
+    in>>magic;
+    quint64 directory_offset = 0;
+    quint16 version = header_version;
+    qint64 directory_end = 0;
+    if(magic == versioned_directory_magic){
+        directory_end = archive_end - versioned_trailer_size;
+        if(directory_end < archive_header_size || !device.seek(directory_end)){
+            return false;
+        }
+        in>>directory_offset>>version;
+        if(version < versioned_trailer_version || version > archive_version){
+            return false;
+        }
+    }else if(magic == directory_magic && header_version < versioned_trailer_version){
+        directory_end = archive_end - trailer_size;
+        if(!device.seek(directory_end)){
+            return false;
+        }
+        in>>directory_offset;
+    }else{
+        return false;
+    }
+    if(in.status() != QDataStream::Ok ||
+            directory_offset < static_cast<quint64>(archive_header_size)){
+        return false;
+    }
+
+    return read_directory(device, version, directory_offset, directory_end, entries);
+}
+
+//Recover the archive for appending. The trailer is at the end of the
+//archive, unless an append was interrupted and left incomplete data
+//after it. Then the last intact trailer is searched backward, the
+//archive is appended as before the interrupted append
+bool find_directory(QIODevice &device, quint16 version,
+                    std::vector<archive_entry> &entries, qint64 &archive_end)
+{
+    archive_end = device.size();
+    if(read_archive_end(device, version, archive_end, entries)){
+        return true;
+    }
+
+    //the directories appended before version 7 end with the old magic
+    QByteArray magic(sizeof(directory_magic), Qt::Uninitialized);
+    qToBigEndian(directory_magic, reinterpret_cast<uchar*>(magic.data()));
+    QByteArray versioned_magic(sizeof(versioned_directory_magic), Qt::Uninitialized);
+    qToBigEndian(versioned_directory_magic, reinterpret_cast<uchar*>(versioned_magic.data()));
+    //from = -1 means search from the end
+    auto last_index = [&](QByteArray const &chunk, int from)
+    {
+        return std::max(chunk.lastIndexOf(magic, from),
+                        chunk.lastIndexOf(versioned_magic, from));
+    };
+    qint64 const chunk_size = 1024 * 1024;
+    qint64 const size = device.size();
+    for(qint64 end = size; end > archive_header_size + trailer_size;){
+        //the chunks overlap so the magic across them is found
+        qint64 const begin = std::max<qint64>(archive_header_size, end - chunk_size);
+        qint64 const read_end = std::min<qint64>(size, end + magic.size() - 1);
+        if(!device.seek(begin)){
+            return false;
+        }
+        QByteArray const chunk = device.read(read_end - begin);
+        int i = last_index(chunk, -1);
+        while(i >= 0){
+            archive_end = begin + i + magic.size();
+            if(archive_end < size && read_archive_end(device, version, archive_end, entries)){
+                return true;
+            }
+            i = i > 0 ? last_index(chunk, i - 1) : -1;
+        }
+        end = begin;
+    }
+
+    return false;
+}
+
+//Write the data in the buffer of the file to the disk
+bool sync_file(QFileDevice &file)
+{
+    if(!file.flush()){
+        return false;
+    }
+#if defined(Q_OS_WIN)
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+}
+
+bool unpack_entry_data(QByteArray const &packed, archive_entry const &entry,
+                       QByteArray &unpacked)
+{
+    if(packed.size() != entry.packed_size_){
+        return false;
+    }
+
+    qint64 const unpacked_size = (entry.flags_ & entry_solid) ?
+                entry.solid_size_ : entry.raw_size_;
+    if(entry.flags_ & entry_stored){
+        unpacked = packed;
+    }else{
+        codec const *entry_codec = find_codec(entry.codec_);
+        if(!entry_codec){//codec is not available in this build
+            return false;
+        }
+        unpacked = entry_codec->decompress(packed.constData(), packed.size(),
+                                           static_cast<int>(unpacked_size));
+    }
+
+    return unpacked.size() == unpacked_size;
+}
+
+bool slice_entry_data(QByteArray const &unpacked, archive_entry const &entry,
+                      QByteArray &data)
+{
+    if(entry.flags_ & entry_solid){
+        if(entry.solid_offset_ < 0 ||
+                entry.solid_offset_ + entry.raw_size_ > unpacked.size()){
+            return false;
+        }
+        data = unpacked.mid(static_cast<int>(entry.solid_offset_),
+                            static_cast<int>(entry.raw_size_));
+    }else{
+        data = unpacked;
+    }
+    if(data.size() != entry.raw_size_){
+        return false;
+    }
+
+    return !entry.has_checksum_ || crc32c(data) == entry.checksum_;
+}
+
+bool write_archive_header(QIODevice &device)
+{
+    QDataStream out(&device);
+    out<<archive_magic<<archive_version;
+
+    return out.status() == QDataStream::Ok;
+}
+
+bool write_archive_index(QIODevice &device,
+                         std::vector<archive_entry> const &entries)
+{
+    QDataStream out(&device);
+    quint64 const directory_offset = static_cast<quint64>(device.pos());
+    out<<static_cast<quint32>(entries.size());
+    for(auto const &entry : entries){
+        out<<entry.name_<<static_cast<quint64>(entry.offset_)
+          <<static_cast<quint64>(entry.packed_size_)
+          <<static_cast<quint64>(entry.raw_size_)<<entry.checksum_<<entry.flags_
+          <<static_cast<quint8>(entry.codec_)
+          <<static_cast<quint64>(entry.solid_offset_)
+          <<static_cast<quint64>(entry.solid_size_)<<entry.mtime_;
+    }
+    out<<directory_offset<<archive_version<<versioned_directory_magic;
+
+    return out.status() == QDataStream::Ok;
+}
+
+bool read_archive_index(QIODevice &device, std::vector<archive_entry> &entries)
+{
+    entries.clear();
+    if(!device.seek(0)){
+        return false;
+    }
+
+    QDataStream in(&device);
+    quint32 magic = 0;
+    quint16 version = 0;
+    in>>magic>>version;
+    if(magic != archive_magic){
+        return read_legacy_index(device, entries);
+    }
+
+    //the reader do not recover, the archive left by an interrupted
+    //append is damaged until the next append
+    return version <= archive_version &&
+            read_archive_end(device, version, device.size(), entries);
+}
+
+bool seek_archive_append(QIODevice &device, std::vector<archive_entry> &entries)
+{
+    entries.clear();
+    if(!device.seek(0)){
+        return false;
+    }
+
+    //the old archive without central directory cannot be appended
+    QDataStream in(&device);
+    quint32 magic = 0;
+    quint16 version = 0;
+    in>>magic>>version;
+    qint64 archive_end = 0;
+    if(in.status() != QDataStream::Ok || magic != archive_magic ||
+            version > archive_version ||
+            !find_directory(device, version, entries, archive_end)){
+        return false;
+    }
+
+    //the tail left by an interrupted append is overwritten
+    return device.seek(archive_end);
+}
+
+bool finish_archive_append(QFileDevice &device,
+                           std::vector<archive_entry> const &entries)
+{
+    //the new data reach the disk before the directory refer to it, the
+    //header is not touched, the directory carry its own version
+    return sync_file(device) && write_archive_index(device, entries) &&
+            device.flush() && device.resize(device.pos()) && sync_file(device);
+}
+
+QByteArray read_archive_entry(QIODevice &device, archive_entry const &entry)
+{
+    if(!device.seek(entry.offset_)){
+        return {};
+    }
+
+    return device.read(entry.packed_size_);
+}
+
+}
+
+}
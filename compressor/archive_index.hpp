@@ -0,0 +1,119 @@
+#ifndef QTE_CP_ARCHIVE_INDEX_HPP
+#define QTE_CP_ARCHIVE_INDEX_HPP
+
+#include "codec.hpp"
+
+#include <QFileDevice>
+#include <QIODevice>
+#include <QString>
+
+#include <vector>
+
+namespace qte{
+
+namespace cp{
+
+//the data of the entry is stored without compression
+quint8 const entry_stored = 0x01;
+//the entry is a part of solid block shared by several entries
+quint8 const entry_solid = 0x02;
+
+/**
+ * Information of a file stored in the archive of folder_compressor
+ */
+struct archive_entry
+{
+    quint32 checksum_ = 0; //crc32c of the uncompressed data
+    codec_id codec_ = codec_id::zlib;
+    quint8 flags_ = 0;
+    bool has_checksum_ = false; //old archive do not store checksum
+    qint64 mtime_ = 0; //last modified time in msecs since epoch, 0 if unknown
+    QString name_; //relative path of the file, always begin with "/"
+    qint64 offset_ = 0; //position of the compressed data in archive
+    qint64 packed_size_ = 0;
+    qint64 raw_size_ = 0;
+    qint64 solid_offset_ = 0; //position of the entry in the uncompressed solid block
+    qint64 solid_size_ = 0; //size of the uncompressed solid block
+};
+
+/**
+ * Uncompress the data of the entry, the data is shared by all of the
+ * entries in the same block if the entry is solid
+ * @param packed compressed data of the entry
+ * @param entry the entry
+ * @param unpacked the data after uncompressed
+ * @return true if success and vice versa
+ */
+bool unpack_entry_data(QByteArray const &packed, archive_entry const &entry,
+                       QByteArray &unpacked);
+
+/**
+ * Take the data of the entry from the data uncompressed by
+ * unpack_entry_data and verify it by the checksum
+ * @return true if the data is intact and vice versa
+ */
+bool slice_entry_data(QByteArray const &unpacked, archive_entry const &entry,
+                      QByteArray &data);
+
+/**
+ * Write the header of the indexed archive at current position of device
+ * @return true if success and vice versa
+ */
+bool write_archive_header(QIODevice &device);
+
+/**
+ * Write the central directory and the trailer of the indexed archive
+ * at current position of the device, this should be the last thing
+ * written into the archive
+ * @return true if success and vice versa
+ */
+bool write_archive_index(QIODevice &device,
+                         std::vector<archive_entry> const &entries);
+
+/**
+ * Read the index of the archive, only the trailer and central directory
+ * of the indexed archive would be read. The old archive without central
+ * directory is supported too, but need to walk through all of the entries.
+ * Fail if the trailer is not at the end of the archive
+ * @param device device of the archive, must be random access
+ * @param entries the entries of the archive, in the order of the
+ * central directory
+ * @return true if success and vice versa
+ */
+bool read_archive_index(QIODevice &device, std::vector<archive_entry> &entries);
+
+/**
+ * Prepare the indexed archive for appending, the index is read and the
+ * device is positioned at the end of the archive. The new data should be
+ * written from there and finished by finish_archive_append. The old
+ * central directory is never overwritten, if the append is interrupted,
+ * read_archive_index fail, but the next append find the last intact
+ * central directory and overwrite the incomplete data after it
+ * @param device device of the archive, must be random access and writable
+ * @param entries the entries of the archive
+ * @return false if the device is not an indexed archive
+ */
+bool seek_archive_append(QIODevice &device, std::vector<archive_entry> &entries);
+
+/**
+ * Write the central directory after the appended data and truncate the
+ * archive there. The data is synced to the disk before the directory is
+ * written and the directory is synced before return
+ * @param device device of the archive
+ * @param entries the entries of the archive after the append
+ * @return true if success and vice versa
+ */
+bool finish_archive_append(QFileDevice &device,
+                           std::vector<archive_entry> const &entries);
+
+/**
+ * Read the compressed data of the entry
+ * @return empty QByteArray if fail
+ */
+QByteArray read_archive_entry(QIODevice &device, archive_entry const &entry);
+
+}
+
+}
+
+#endif // QTE_CP_ARCHIVE_INDEX_HPP
@@ -0,0 +1,131 @@
+#include "archive_job.hpp"
+
+#include <QFutureInterface>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+
+namespace qte{
+
+namespace cp{
+
+archive_job::archive_job(QObject *parent) :
+    QObject(parent),
+    cancelled_(false),
+    last_report_(0),
+    pool_(QThreadPool::globalInstance()),
+    progress_interval_(100)
+{
+    compressor_.set_progress_callback([this](qint64 done_bytes, qint64 total_bytes,
+                                      qint64 done_files, qint64 total_files)
+    {
+        return report_progress(done_bytes, total_bytes, done_files, total_files);
+    });
+}
+
+archive_job::~archive_job()
+{
+    cancel();
+    future_.waitForFinished();
+}
+
+void archive_job::cancel()
+{
+    //the compressor stop inside a big entry, the flag of the job catch
+    //the cancel before the compressor start
+    cancelled_ = true;
+    compressor_.cancel();
+}
+
+QFuture<bool> archive_job::compress_folder(QString const &sourceFolder,
+                                           QString const &destinationFile,
+                                           QStringList const &exclude_content,
+                                           int compression_level)
+{
+    return start([this, sourceFolder, destinationFile, exclude_content, compression_level]()
+    {
+        return compressor_.compress_folder(sourceFolder, destinationFile,
+                                           exclude_content, compression_level);
+    });
+}
+
+folder_compressor& archive_job::compressor()
+{
+    return compressor_;
+}
+
+QFuture<bool> archive_job::decompress_folder(QString const &sourceFile,
+                                             QString const &destinationFolder)
+{
+    return start([this, sourceFile, destinationFolder]()
+    {
+        return compressor_.decompress_folder(sourceFile, destinationFolder);
+    });
+}
+
+QFuture<bool> archive_job::future() const
+{
+    return future_;
+}
+
+bool archive_job::is_running() const
+{
+    return !future_.isFinished();
+}
+
+void archive_job::set_progress_interval(int msec)
+{
+    progress_interval_ = msec;
+}
+
+void archive_job::set_thread_pool(QThreadPool *pool)
+{
+    pool_ = pool;
+}
+
+bool archive_job::report_progress(qint64 done_bytes, qint64 total_bytes,
+                                  qint64 done_files, qint64 total_files)
+{
+    //the compressor report every block, throttle the signals so the
+    //event loop of the receivers is not flooded
+    qint64 const elapsed = elapsed_.elapsed();
+    bool const last = done_bytes == total_bytes && done_files == total_files;
+    if(last || elapsed - last_report_ >= progress_interval_){
+        last_report_ = elapsed;
+        qint64 eta_msec = -1;
+        if(done_bytes > 0){
+            eta_msec = static_cast<qint64>(static_cast<double>(total_bytes - done_bytes) *
+                                           elapsed / done_bytes);
+        }
+        emit progress(done_bytes, total_bytes, done_files, total_files, eta_msec);
+    }
+
+    return !cancelled_;
+}
+
+template<typename Func>
+QFuture<bool> archive_job::start(Func func)
+{
+    if(is_running()){
+        QFutureInterface<bool> busy;
+        bool const result = false;
+        busy.reportStarted();
+        busy.reportFinished(&result);
+        return busy.future();
+    }
+
+    cancelled_ = false;
+    last_report_ = 0;
+    elapsed_.start();
+    future_ = QtConcurrent::run(pool_, [this, func]()
+    {
+        bool const success = func();
+        emit finished(success);
+        return success;
+    });
+
+    return future_;
+}
+
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef QTE_CP_ARCHIVE_JOB_HPP
+#define QTE_CP_ARCHIVE_JOB_HPP
+
+#include "folder_compressor.hpp"
+
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QObject>
+#include <QStringList>
+
+#include <atomic>
+
+class QThreadPool;
+
+namespace qte{
+
+namespace cp{
+
+/**
+ * Run compress_folder or decompress_folder of folder_compressor on a
+ * thread pool without blocking the caller, report the progress by
+ * signal and support cancellation. One job handle one archive at a
+ * time, create several jobs to build several archives at once
+ */
+class archive_job : public QObject
+{
+    Q_OBJECT
+public:
+    explicit archive_job(QObject *parent = nullptr);
+
+    /**
+     * Cancel the running job and wait until it stop
+     */
+    ~archive_job();
+
+    /**
+     * Ask the running job to stop at the next block, the future
+     * return false if the job is cancelled
+     */
+    void cancel();
+
+    /**
+     * Start folder_compressor::compress_folder asynchronously
+     * @return handle of the job, the result is false if the job is
+     * still running
+     */
+    QFuture<bool> compress_folder(QString const &sourceFolder,
+                                  QString const &destinationFile,
+                                  QStringList const &exclude_content = {},
+                                  int compression_level = 9);
+
+    /**
+     * The compressor used by the job, configure it(thread count, codec
+     * etc) before the job start. Do not change it while the job is running
+     */
+    folder_compressor& compressor();
+
+    /**
+     * Start folder_compressor::decompress_folder asynchronously
+     * @return handle of the job, the result is false if the job is
+     * still running
+     */
+    QFuture<bool> decompress_folder(QString const &sourceFile,
+                                    QString const &destinationFolder);
+
+    QFuture<bool> future() const;
+
+    bool is_running() const;
+
+    /**
+     * Minimum interval between two progress signals, the last progress
+     * is always emitted. Default value is 100
+     * @param msec interval in milliseconds
+     */
+    void set_progress_interval(int msec);
+
+    /**
+     * The pool which run the jobs, the job occupy one thread of the pool
+     * and the compressor use its own threads. Default value is
+     * QThreadPool::globalInstance()
+     * @param pool the pool, must outlive the job
+     */
+    void set_thread_pool(QThreadPool *pool);
+
+signals:
+    void finished(bool success);
+    /**
+     * @param eta_msec estimated milliseconds to finish, -1 if unknown
+     */
+    void progress(qint64 done_bytes, qint64 total_bytes,
+                  qint64 done_files, qint64 total_files,
+                  qint64 eta_msec);
+
+private:
+    bool report_progress(qint64 done_bytes, qint64 total_bytes,
+                         qint64 done_files, qint64 total_files);
+    template<typename Func>
+    QFuture<bool> start(Func func);
+
+    std::atomic<bool> cancelled_;
+    folder_compressor compressor_;
+    QElapsedTimer elapsed_;
+    QFuture<bool> future_;
+    qint64 last_report_;
+    QThreadPool *pool_;
+    int progress_interval_;
+};
+
+}
+
+}
+
+#endif // QTE_CP_ARCHIVE_JOB_HPP
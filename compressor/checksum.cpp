@@ -0,0 +1,151 @@
+#include "checksum.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define QTE_CP_CRC32C_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace qte{
+
+namespace cp{
+
+namespace{
+
+//slicing-by-8, table[k][i] is the crc of byte i followed by k zero bytes
+using crc_table = std::array<std::array<quint32, 256>, 8>;
+
+crc_table make_crc_table()
+{
+    //reversed polynomial of CRC-32C
+    quint32 const polynomial = 0x82F63B78;
+    crc_table table;
+    for(quint32 i = 0; i != 256; ++i){
+        quint32 crc = i;
+        for(int j = 0; j != 8; ++j){
+            crc = (crc & 1) ? (crc >> 1) ^ polynomial : crc >> 1;
+        }
+        table[0][i] = crc;
+    }
+    for(quint32 i = 0; i != 256; ++i){
+        for(size_t k = 1; k != table.size(); ++k){
+            table[k][i] = table[0][table[k - 1][i] & 0xFF] ^ (table[k - 1][i] >> 8);
+        }
+    }
+
+    return table;
+}
+
+quint32 crc32c_software(uchar const *ptr, qint64 size, quint32 crc)
+{
+    static crc_table const table = make_crc_table();
+
+    for(; size >= 8; ptr += 8, size -= 8){
+        //the table is built for little endian words
+        quint32 const low = crc ^ (quint32(ptr[0]) | quint32(ptr[1]) << 8 |
+                quint32(ptr[2]) << 16 | quint32(ptr[3]) << 24);
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^
+                table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+                table[3][ptr[4]] ^ table[2][ptr[5]] ^
+                table[1][ptr[6]] ^ table[0][ptr[7]];
+    }
+    for(; size != 0; ++ptr, --size){
+        crc = table[0][(crc ^ *ptr) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#ifdef QTE_CP_CRC32C_X86
+
+#if defined(__GNUC__) || defined(__clang__)
+#define QTE_CP_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define QTE_CP_TARGET_SSE42
+#endif
+
+//crc32 instruction of SSE4.2 compute CRC-32C, it is several times
+//faster than the table
+QTE_CP_TARGET_SSE42
+quint32 crc32c_sse42(uchar const *ptr, qint64 size, quint32 crc)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    quint64 crc64 = crc;
+    for(; size >= 8; ptr += 8, size -= 8){
+        quint64 word;
+        std::memcpy(&word, ptr, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<quint32>(crc64);
+#endif
+    for(; size >= 4; ptr += 4, size -= 4){
+        quint32 word;
+        std::memcpy(&word, ptr, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for(; size != 0; ++ptr, --size){
+        crc = _mm_crc32_u8(crc, *ptr);
+    }
+
+    return crc;
+}
+
+bool has_sse42()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#endif
+
+using crc32c_func = quint32 (*)(uchar const*, qint64, quint32);
+
+crc32c_func select_crc32c()
+{
+#ifdef QTE_CP_CRC32C_X86
+    if(has_sse42()){
+        return crc32c_sse42;
+    }
+#endif
+
+    return crc32c_software;
+}
+
+}
+
+quint32 crc32c(char const *data, qint64 size, quint32 crc)
+{
+    //the cpu is checked once, the result is the same on every path
+    static crc32c_func const func = select_crc32c();
+
+    return ~func(reinterpret_cast<uchar const*>(data), size, ~crc);
+}
+
+quint32 crc32c(QByteArray const &data, quint32 crc)
+{
+    return crc32c(data.constData(), data.size(), crc);
+}
+
+bool crc32c_hardware_accelerated()
+{
+#ifdef QTE_CP_CRC32C_X86
+    static bool const accelerated = has_sse42();
+    return accelerated;
+#else
+    return false;
+#endif
+}
+
+}
+
+}
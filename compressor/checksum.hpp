@@ -0,0 +1,35 @@
+#ifndef QTE_CP_CHECKSUM_HPP
+#define QTE_CP_CHECKSUM_HPP
+
+#include <QByteArray>
+
+namespace qte{
+
+namespace cp{
+
+/**
+ * Compute the CRC-32C(Castagnoli) of the data, use the crc32
+ * instruction of SSE4.2 if the cpu support it
+ * @param data data want to compute the checksum
+ * @param size size of the data
+ * @param crc checksum of the previous data, use it to compute
+ * the checksum of the data spread across several buffers
+ * @return checksum of the data
+ */
+quint32 crc32c(char const *data, qint64 size, quint32 crc = 0);
+
+/**
+ * Overload of crc32c(data, size, crc)
+ */
+quint32 crc32c(QByteArray const &data, quint32 crc = 0);
+
+/**
+ * @return true if crc32c is computed by the hardware instruction
+ */
+bool crc32c_hardware_accelerated();
+
+}
+
+}
+
+#endif // QTE_CP_CHECKSUM_HPP
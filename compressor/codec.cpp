@@ -0,0 +1,175 @@
+#include "codec.hpp"
+
+#ifdef QTE_HAS_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#ifdef QTE_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace qte{
+
+namespace cp{
+
+namespace{
+
+//The output is the same as qCompress, so the data compressed before
+//the codec is recorded can be decompressed by this codec too
+class zlib_codec : public codec
+{
+public:
+    QByteArray compress(char const *data, int size, int level) const override
+    {
+        return qCompress(reinterpret_cast<uchar const*>(data), size, level);
+    }
+
+    QByteArray decompress(char const *data, int size, int) const override
+    {
+        return qUncompress(reinterpret_cast<uchar const*>(data), size);
+    }
+
+    codec_id id() const override
+    {
+        return codec_id::zlib;
+    }
+
+    int max_level() const override
+    {
+        return 9;
+    }
+};
+
+#ifdef QTE_HAS_LZ4
+//level <= 2 use the fast compressor, larger level use the high
+//compression variant, decompression speed are the same
+class lz4_codec : public codec
+{
+public:
+    QByteArray compress(char const *data, int size, int level) const override
+    {
+        QByteArray result(LZ4_compressBound(size), Qt::Uninitialized);
+        int const packed_size = level <= 2 ?
+                    LZ4_compress_default(data, result.data(), size, result.size()) :
+                    LZ4_compress_HC(data, result.data(), size, result.size(), level);
+        if(packed_size <= 0){
+            return {};
+        }
+        result.resize(packed_size);
+
+        return result;
+    }
+
+    QByteArray decompress(char const *data, int size, int raw_size) const override
+    {
+        if(raw_size < 0){
+            return {};
+        }
+
+        QByteArray result(raw_size, Qt::Uninitialized);
+        if(LZ4_decompress_safe(data, result.data(), size, raw_size) != raw_size){
+            return {};
+        }
+
+        return result;
+    }
+
+    codec_id id() const override
+    {
+        return codec_id::lz4;
+    }
+
+    int max_level() const override
+    {
+        return LZ4HC_CLEVEL_MAX;
+    }
+};
+#endif
+
+#ifdef QTE_HAS_ZSTD
+class zstd_codec : public codec
+{
+public:
+    QByteArray compress(char const *data, int size, int level) const override
+    {
+        QByteArray result(static_cast<int>(ZSTD_compressBound(size)), Qt::Uninitialized);
+        size_t const packed_size = ZSTD_compress(result.data(), result.size(),
+                                                 data, size, level);
+        if(ZSTD_isError(packed_size)){
+            return {};
+        }
+        result.resize(static_cast<int>(packed_size));
+
+        return result;
+    }
+
+    QByteArray decompress(char const *data, int size, int raw_size) const override
+    {
+        if(raw_size < 0){
+            return {};
+        }
+
+        QByteArray result(raw_size, Qt::Uninitialized);
+        size_t const decompressed = ZSTD_decompress(result.data(), result.size(),
+                                                    data, size);
+        if(ZSTD_isError(decompressed) || decompressed != static_cast<size_t>(raw_size)){
+            return {};
+        }
+
+        return result;
+    }
+
+    codec_id id() const override
+    {
+        return codec_id::zstd;
+    }
+
+    int max_level() const override
+    {
+        return ZSTD_maxCLevel();
+    }
+};
+#endif
+
+}
+
+codec const* find_codec(codec_id id)
+{
+    switch(id){
+    case codec_id::zlib:{
+        static zlib_codec const zlib{};
+        return &zlib;
+    }
+#ifdef QTE_HAS_LZ4
+    case codec_id::lz4:{
+        static lz4_codec const lz4{};
+        return &lz4;
+    }
+#endif
+#ifdef QTE_HAS_ZSTD
+    case codec_id::zstd:{
+        static zstd_codec const zstd{};
+        return &zstd;
+    }
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+std::vector<codec_id> available_codecs()
+{
+    std::vector<codec_id> result;
+    for(auto const id : {codec_id::zlib, codec_id::lz4, codec_id::zstd}){
+        if(find_codec(id)){
+            result.emplace_back(id);
+        }
+    }
+
+    return result;
+}
+
+}
+
+}
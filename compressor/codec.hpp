@@ -0,0 +1,75 @@
+#ifndef QTE_CP_CODEC_HPP
+#define QTE_CP_CODEC_HPP
+
+#include <QByteArray>
+
+#include <vector>
+
+namespace qte{
+
+namespace cp{
+
+/**
+ * Id of the codecs, the value is recorded in the compressed data,
+ * never change the value of existing codec
+ */
+enum class codec_id : quint8
+{
+    zlib = 0,
+    lz4 = 1,
+    zstd = 2
+};
+
+/**
+ * Interface of the compression algorithm used by file_compressor and
+ * folder_compressor. zlib is always available, lz4 and zstd are only
+ * available if the library is found at build time(QTE_HAS_LZ4, QTE_HAS_ZSTD)
+ */
+class codec
+{
+public:
+    virtual ~codec() = default;
+
+    /**
+     * @param data data want to compress
+     * @param size size of the data
+     * @param level compression level, meaning of the level depend on
+     * the codec, larger value trade speed for ratio
+     * @return compressed data, empty if fail
+     */
+    virtual QByteArray compress(char const *data, int size, int level) const = 0;
+
+    /**
+     * @param data data want to decompress
+     * @param size size of the data
+     * @param raw_size size of the data before compression, fail if it
+     * is negative
+     * @return decompressed data, empty if fail
+     */
+    virtual QByteArray decompress(char const *data, int size, int raw_size) const = 0;
+
+    virtual codec_id id() const = 0;
+
+    /**
+     * @return the highest compression level, the levels of every codec
+     * begin from 1
+     */
+    virtual int max_level() const = 0;
+};
+
+/**
+ * Find the codec by id
+ * @return nullptr if the codec is not available in this build
+ */
+codec const* find_codec(codec_id id);
+
+/**
+ * @return id of the codecs available in this build
+ */
+std::vector<codec_id> available_codecs();
+
+}
+
+}
+
+#endif // QTE_CP_CODEC_HPP
@@ -0,0 +1,336 @@
+#include "compress_device.hpp"
+#include "stream_format.hpp"
+
+#include <QDataStream>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+namespace qte{
+
+namespace cp{
+
+compress_device::compress_device(QIODevice *target, int compression_level,
+                                 int block_size, codec_id codec_type,
+                                 QObject *parent) :
+    QIODevice(parent),
+    block_size_(block_size),
+    codec_(find_codec(codec_type)),
+    codec_type_(codec_type),
+    compression_level_(compression_level),
+    failed_(false),
+    target_(target)
+{
+}
+
+compress_device::~compress_device()
+{
+    if(isOpen()){
+        close();
+    }
+}
+
+void compress_device::close()
+{
+    if(!isOpen()){
+        return;
+    }
+
+    //without the end of the stream the data cannot be decompressed,
+    //the error is kept after close
+    if(write_block()){
+        QDataStream out(target_);
+        out<<quint8(0)<<quint32(0)<<quint32(0);
+        failed_ = failed_ || out.status() != QDataStream::Ok;
+    }
+    QIODevice::close();
+    if(failed_){
+        setErrorString(tr("Cannot write the compressed data"));
+    }
+}
+
+bool compress_device::has_error() const
+{
+    return failed_;
+}
+
+bool compress_device::isSequential() const
+{
+    return true;
+}
+
+bool compress_device::open(OpenMode mode)
+{
+    if(mode.testFlag(QIODevice::ReadOnly) || !mode.testFlag(QIODevice::WriteOnly) ||
+            !target_ || !target_->isWritable() || !codec_ ||
+            block_size_ <= 0 || block_size_ > max_stream_block_size){
+        return false;
+    }
+
+    QDataStream out(target_);
+    out<<stream_magic<<stream_version<<static_cast<quint32>(block_size_)
+      <<static_cast<quint8>(codec_type_);
+    if(out.status() != QDataStream::Ok){
+        return false;
+    }
+    buffer_.clear();
+    buffer_.reserve(block_size_);
+    failed_ = false;
+
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+qint64 compress_device::readData(char*, qint64)
+{
+    return -1;
+}
+
+qint64 compress_device::writeData(char const *data, qint64 maxSize)
+{
+    qint64 written = 0;
+    while(written != maxSize){
+        int const size = static_cast<int>(std::min<qint64>(block_size_ - buffer_.size(),
+                                                           maxSize - written));
+        buffer_.append(data + written, size);
+        written += size;
+        if(buffer_.size() == block_size_ && !write_block()){
+            return -1;
+        }
+    }
+
+    return written;
+}
+
+bool compress_device::write_block()
+{
+    if(buffer_.isEmpty()){
+        return true;
+    }
+
+    QByteArray packed;
+    bool const stored = pack_block(*codec_, buffer_, compression_level_, packed);
+    QDataStream out(target_);
+    out<<static_cast<quint8>(stored ? block_stored : 0)
+      <<static_cast<quint32>(buffer_.size())
+      <<static_cast<quint32>(packed.size());
+    out.writeRawData(packed.constData(), packed.size());
+    buffer_.resize(0);
+    if(out.status() != QDataStream::Ok){
+        failed_ = true;
+        setErrorString(tr("Cannot write the compressed data"));
+        return false;
+    }
+
+    return true;
+}
+
+decompress_device::decompress_device(QIODevice *source, QObject *parent) :
+    QIODevice(parent),
+    codec_(nullptr),
+    corrupted_(false),
+    end_of_stream_(false),
+    has_header_(false),
+    max_block_size_(0),
+    output_pos_(0),
+    source_(source),
+    source_finished_(false),
+    version_(0)
+{
+    if(source_){
+        connect(source_, &QIODevice::readChannelFinished, this, [this]()
+        {
+            source_finished_ = true;
+        });
+        //decode the block as soon as it arrive, so bytesAvailable tell
+        //the size of the data before the first read
+        connect(source_, &QIODevice::readyRead, this, [this]()
+        {
+            if(!isOpen()){
+                return;
+            }
+            bool const finished = end_of_stream_ || corrupted_;
+            if(output_pos_ == output_.size() && !finished){
+                decode_block();
+            }
+            if(output_pos_ != output_.size() ||
+                    (!finished && (end_of_stream_ || corrupted_))){
+                emit readyRead();
+            }
+        });
+        connect(source_, &QIODevice::readChannelFinished,
+                this, &QIODevice::readChannelFinished);
+    }
+}
+
+bool decompress_device::atEnd() const
+{
+    return (end_of_stream_ || corrupted_) && output_pos_ == output_.size();
+}
+
+qint64 decompress_device::bytesAvailable() const
+{
+    return output_.size() - output_pos_ + QIODevice::bytesAvailable();
+}
+
+bool decompress_device::isSequential() const
+{
+    return true;
+}
+
+bool decompress_device::open(OpenMode mode)
+{
+    if(mode.testFlag(QIODevice::WriteOnly) || !mode.testFlag(QIODevice::ReadOnly) ||
+            !source_ || !source_->isReadable()){
+        return false;
+    }
+
+    codec_ = nullptr;
+    corrupted_ = false;
+    end_of_stream_ = false;
+    has_header_ = false;
+    input_.clear();
+    output_.clear();
+    output_pos_ = 0;
+
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+qint64 decompress_device::readData(char *data, qint64 maxSize)
+{
+    qint64 total = 0;
+    while(total != maxSize){
+        if(output_pos_ == output_.size() &&
+                (end_of_stream_ || corrupted_ || !decode_block())){
+            break;
+        }
+
+        int const size = static_cast<int>(std::min<qint64>(output_.size() - output_pos_,
+                                                           maxSize - total));
+        std::memcpy(data + total, output_.constData() + output_pos_, static_cast<size_t>(size));
+        output_pos_ += size;
+        total += size;
+    }
+    //decode the next block ahead if the source has it, so bytesAvailable
+    //count the data arrived before the next readyRead
+    if(total != 0 && output_pos_ == output_.size() && !end_of_stream_ && !corrupted_){
+        decode_block();
+    }
+    if(total == 0 && (end_of_stream_ || corrupted_)){
+        return -1;
+    }
+
+    return total;
+}
+
+qint64 decompress_device::writeData(char const*, qint64)
+{
+    return -1;
+}
+
+bool decompress_device::decode_block()
+{
+    if(!has_header_ && !read_header()){
+        return false;
+    }
+
+    //the source may be sequential, wait until the whole block arrive
+    int const header_size = block_header_size(version_);
+    if(!fill_input(header_size)){
+        return false;
+    }
+    auto const *ptr = reinterpret_cast<uchar const*>(input_.constData());
+    quint8 const flags = version_ >= 2 ? ptr[0] : 0;
+    ptr += version_ >= 2 ? 1 : 0;
+    quint32 const raw_size = qFromBigEndian<quint32>(ptr);
+    quint32 const packed_size = qFromBigEndian<quint32>(ptr + sizeof(quint32));
+    if(raw_size == 0){
+        input_.remove(0, header_size);
+        end_of_stream_ = true;
+        return false;
+    }
+    if(raw_size > max_block_size_ || packed_size > max_packed_block_size(max_block_size_)){
+        corrupted_ = true;
+        setErrorString(tr("Corrupted block header"));
+        return false;
+    }
+
+    int const frame_size = header_size + static_cast<int>(packed_size);
+    if(!fill_input(frame_size)){
+        return false;
+    }
+    char const *packed = input_.constData() + header_size;
+    output_ = (flags & block_stored) ?
+                QByteArray(packed, static_cast<int>(packed_size)) :
+                codec_->decompress(packed, static_cast<int>(packed_size),
+                                   static_cast<int>(raw_size));
+    output_pos_ = 0;
+    input_.remove(0, frame_size);
+    if(output_.size() != static_cast<int>(raw_size)){
+        output_.clear();
+        corrupted_ = true;
+        setErrorString(tr("Corrupted block data"));
+        return false;
+    }
+
+    return true;
+}
+
+bool decompress_device::fill_input(int size)
+{
+    if(input_.size() < size){
+        input_ += source_->read(size - input_.size());
+    }
+    if(input_.size() >= size){
+        return true;
+    }
+
+    //the sequential source may get more data later, unless it is
+    //finished or closed. Otherwise the stream is truncated
+    if(!source_->isOpen() || source_finished_ ||
+            (!source_->isSequential() && source_->atEnd())){
+        corrupted_ = true;
+        setErrorString(tr("Truncated stream"));
+    }
+
+    return false;
+}
+
+bool decompress_device::read_header()
+{
+    //magic and version decide the size of the rest of the header
+    int const version_end = sizeof(quint32) + sizeof(quint16);
+    if(!fill_input(version_end)){
+        return false;
+    }
+    auto const *ptr = reinterpret_cast<uchar const*>(input_.constData());
+    version_ = qFromBigEndian<quint16>(ptr + sizeof(quint32));
+    if(qFromBigEndian<quint32>(ptr) != stream_magic ||
+            version_ == 0 || version_ > stream_version){
+        corrupted_ = true;
+        setErrorString(tr("Unknown stream format"));
+        return false;
+    }
+
+    int const header_size = stream_header_size(version_);
+    if(!fill_input(header_size)){
+        return false;
+    }
+    ptr = reinterpret_cast<uchar const*>(input_.constData());
+    max_block_size_ = qFromBigEndian<quint32>(ptr + version_end);
+    quint8 const id = version_ >= 3 ? ptr[header_size - 1] :
+                                      static_cast<quint8>(codec_id::zlib);
+    codec_ = find_codec(static_cast<codec_id>(id));
+    if(!codec_ || max_block_size_ == 0 ||
+            max_block_size_ > static_cast<quint32>(max_stream_block_size)){
+        corrupted_ = true;
+        setErrorString(tr("Unsupported codec or block size"));
+        return false;
+    }
+    input_.remove(0, header_size);
+    has_header_ = true;
+
+    return true;
+}
+
+}}
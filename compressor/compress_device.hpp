@@ -0,0 +1,131 @@
+#ifndef QTE_CP_COMPRESS_DEVICE_HPP
+#define QTE_CP_COMPRESS_DEVICE_HPP
+
+#include "codec.hpp"
+
+#include <QByteArray>
+#include <QIODevice>
+
+namespace qte{
+
+namespace cp{
+
+/**
+ * Compress the data written into this device and write them into the
+ * target device, the output is the same format as qte::cp::compress, so
+ * it can be decompressed by qte::cp::decompress or decompress_device.
+ * Only one block of data is buffered, the stream is finished when the
+ * device is closed
+ */
+class compress_device : public QIODevice
+{
+    Q_OBJECT
+public:
+    /**
+     * @param target device to write the compressed data, must be opened
+     * for writing and outlive this device
+     * @param compression_level compression level of the codec
+     * @param block_size size of each block before compression, must be
+     * larger than 0 and no larger than 64MB
+     * @param codec_type compression algorithm
+     */
+    explicit compress_device(QIODevice *target, int compression_level = 9,
+                             int block_size = 1024 * 1024,
+                             codec_id codec_type = codec_id::zlib,
+                             QObject *parent = nullptr);
+    ~compress_device() override;
+
+    /**
+     * Flush the buffered block and write the end of the stream
+     */
+    void close() override;
+
+    /**
+     * @return true if the compressed data or the end of the stream
+     * cannot be written into the target, the stream is unusable.
+     * errorString() tell the reason, kept after close
+     */
+    bool has_error() const;
+    bool isSequential() const override;
+
+    /**
+     * Only QIODevice::WriteOnly is supported, the header of the stream
+     * is written when the device is opened
+     */
+    bool open(OpenMode mode) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(char const *data, qint64 maxSize) override;
+
+private:
+    bool write_block();
+
+    QByteArray buffer_;
+    int block_size_;
+    codec const *codec_;
+    codec_id codec_type_;
+    int compression_level_;
+    bool failed_;
+    QIODevice *target_;
+};
+
+/**
+ * Decompress the data of the source device, the source should be the
+ * format of qte::cp::compress or compress_device. The source can be
+ * sequential(socket, QProcess, QNetworkReply), this device emit readyRead
+ * when a block of the source is decompressed, only the data of one block
+ * are buffered
+ */
+class decompress_device : public QIODevice
+{
+    Q_OBJECT
+public:
+    /**
+     * @param source device to read the compressed data, must be opened
+     * for reading and outlive this device
+     */
+    explicit decompress_device(QIODevice *source, QObject *parent = nullptr);
+
+    /**
+     * @return true if all of the data are read and the end of the stream
+     * is reached, or the stream is corrupted or truncated(the source end
+     * before the end of the stream), errorString() tell the reason of
+     * the latter
+     */
+    bool atEnd() const override;
+    qint64 bytesAvailable() const override;
+    bool isSequential() const override;
+
+    /**
+     * Only QIODevice::ReadOnly is supported
+     */
+    bool open(OpenMode mode) override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(char const *data, qint64 maxSize) override;
+
+private:
+    bool decode_block();
+    bool fill_input(int size);
+    bool read_header();
+
+    codec const *codec_;
+    bool corrupted_;
+    bool end_of_stream_;
+    QByteArray input_;
+    bool has_header_;
+    quint32 max_block_size_;
+    QByteArray output_;
+    int output_pos_;
+    QIODevice *source_;
+    bool source_finished_; //source emitted readChannelFinished
+    quint16 version_;
+};
+
+}
+
+}
+
+#endif // QTE_CP_COMPRESS_DEVICE_HPP
@@ -0,0 +1,60 @@
+#include "compressibility.hpp"
+
+#include <QByteArray>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace qte{
+
+namespace cp{
+
+namespace{
+
+qint64 const min_sample_size = 512;
+qint64 const max_sample_size = 64 * 1024;
+//bits per byte, the already compressed data are very close to 8
+double const max_compressible_entropy = 7.5;
+
+double estimate_entropy(uchar const *data, qint64 size)
+{
+    std::array<qint64, 256> histogram{};
+    for(qint64 i = 0; i != size; ++i){
+        ++histogram[data[i]];
+    }
+
+    double entropy = 0;
+    for(auto const count : histogram){
+        if(count > 0){
+            double const prob = count / static_cast<double>(size);
+            entropy -= prob * std::log2(prob);
+        }
+    }
+
+    return entropy;
+}
+
+}
+
+bool is_compressible(char const *data, qint64 size)
+{
+    qint64 const sample_size = std::min(size, max_sample_size);
+    if(sample_size < min_sample_size){//too small to judge
+        return true;
+    }
+
+    auto const *sample = reinterpret_cast<uchar const*>(data);
+    if(estimate_entropy(sample, sample_size) < max_compressible_entropy){
+        return true;
+    }
+
+    //evenly distributed bytes may still contain repeated sequences,
+    //confirm by compressing the sample with the fastest level
+    QByteArray const packed = qCompress(sample, static_cast<int>(sample_size), 1);
+    return packed.size() < sample_size - sample_size / 10;
+}
+
+}
+
+}
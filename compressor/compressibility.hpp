@@ -0,0 +1,25 @@
+#ifndef QTE_CP_COMPRESSIBILITY_HPP
+#define QTE_CP_COMPRESSIBILITY_HPP
+
+#include <QtGlobal>
+
+namespace qte{
+
+namespace cp{
+
+/**
+ * Estimate whether the data worth to compress, only a sample at
+ * the beginning of the data is examined, so the cost is small and
+ * do not grow with the size of the data. Data like jpeg, mp4 or zip
+ * file are considered incompressible
+ * @param data data want to compress
+ * @param size size of the data
+ * @return false if compression very likely cannot shrink the data
+ */
+bool is_compressible(char const *data, qint64 size);
+
+}
+
+}
+
+#endif // QTE_CP_COMPRESSIBILITY_HPP
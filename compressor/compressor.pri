@@ -0,0 +1,38 @@
+#sources of the compressor module, shared by the library and the benchmark
+
+#optional codecs of the compressor module
+CONFIG += link_pkgconfig
+packagesExist(liblz4) {
+    DEFINES += QTE_HAS_LZ4
+    PKGCONFIG += liblz4
+}
+packagesExist(libzstd) {
+    DEFINES += QTE_HAS_ZSTD
+    PKGCONFIG += libzstd
+}
+
+SOURCES += $$PWD/adaptive_level.cpp \
+    $$PWD/archive_fs.cpp \
+    $$PWD/archive_index.cpp \
+    $$PWD/archive_job.cpp \
+    $$PWD/checksum.cpp \
+    $$PWD/codec.cpp \
+    $$PWD/compress_device.cpp \
+    $$PWD/compressibility.cpp \
+    $$PWD/file_compressor.cpp \
+    $$PWD/folder_compressor.cpp \
+    $$PWD/folder_scanner.cpp \
+    $$PWD/stream_format.cpp
+
+HEADERS += $$PWD/adaptive_level.hpp \
+    $$PWD/archive_fs.hpp \
+    $$PWD/archive_index.hpp \
+    $$PWD/archive_job.hpp \
+    $$PWD/checksum.hpp \
+    $$PWD/codec.hpp \
+    $$PWD/compress_device.hpp \
+    $$PWD/compressibility.hpp \
+    $$PWD/file_compressor.hpp \
+    $$PWD/folder_compressor.hpp \
+    $$PWD/folder_scanner.hpp \
+    $$PWD/stream_format.hpp
@@ -1,15 +1,257 @@
 #include "file_compressor.hpp"
+#include "adaptive_level.hpp"
+#include "stream_format.hpp"
 
 #include <QByteArray>
+#include <QDataStream>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 namespace qte{
 
 namespace cp{
 
-bool compress(QString const &file_name, QString const &compress_file_name,
-               int compression_level)
-{    
+namespace{
+
+struct block
+{
+    int level_ = 9;
+    QByteArray packed_;
+    QByteArray raw_;
+    quint32 raw_size_ = 0;
+    bool done_ = false;
+    bool stored_ = false;
+};
+
+//Map the whole file into memory, so the blocks can refer to the
+//mapped pages instead of copying them into heap. Return nullptr if
+//the file cannot be mapped, the caller should fall back to read()
+uchar const* map_file(QFile &file)
+{
+    qint64 const size = file.size();
+    if(size <= 0 || static_cast<quint64>(size) > std::numeric_limits<size_t>::max()){
+        return nullptr;
+    }
+
+    return file.map(0, size);
+}
+
+int resolve_thread_count(int thread_count)
+{
+    return thread_count > 0 ? thread_count :
+                              std::max(1, QThread::idealThreadCount());
+}
+
+//Read the blocks in order, process them on the pool and write them
+//in the same order. The writer only wait for the oldest block, the
+//blocks after it are read and processed meanwhile, at most
+//blocks.size() blocks are in flight.
+//read(block&, bool &end_of_input) fill the next block or set end_of_input,
+//process(block&) run on the pool, write(block const&) run on the caller
+//thread, read and write return false on error
+template<typename Read, typename Process, typename Write>
+bool pipeline_blocks(int thread_count, std::vector<block> &blocks,
+                     Read read, Process process, Write write)
+{
+    QMutex mutex;
+    QWaitCondition block_done;
+    //destroyed before the mutex and the condition, so the workers still
+    //running after an early return finish before they are gone
+    QThreadPool pool;
+    pool.setMaxThreadCount(thread_count);
+    size_t const capacity = blocks.size();
+    size_t next_read = 0;
+    size_t next_write = 0;
+    bool end_of_input = false;
+    while(true){
+        while(!end_of_input && next_read - next_write != capacity){
+            block &blk = blocks[next_read % capacity];
+            if(!read(blk, end_of_input)){
+                return false;
+            }
+            if(end_of_input){
+                break;
+            }
+            ++next_read;
+            if(thread_count == 1){
+                process(blk);
+                blk.done_ = true;
+                continue;
+            }
+
+            blk.done_ = false;
+            block *ptr = &blk;
+            pool.start([ptr, process, &mutex, &block_done]()
+            {
+                process(*ptr);
+                QMutexLocker lock(&mutex);
+                ptr->done_ = true;
+                block_done.wakeAll();
+            });
+        }
+        if(next_write == next_read){
+            return true;
+        }
+
+        block const &blk = blocks[next_write % capacity];
+        {
+            QMutexLocker lock(&mutex);
+            while(!blk.done_){
+                block_done.wait(&mutex);
+            }
+        }
+        if(!write(blk)){
+            return false;
+        }
+        ++next_write;
+    }
+}
+
+bool decompress_legacy(QFile &infile, QFile &outfile)
+{
+    QByteArray const compressed_data = infile.readAll();
+    QByteArray const uncompressed_data = qUncompress(compressed_data);
+    if(uncompressed_data.isEmpty() && !compressed_data.isEmpty()){
+        return false;
+    }
+
+    return outfile.write(uncompressed_data) == uncompressed_data.size();
+}
+
+bool is_cancelled(std::atomic<bool> const *cancelled)
+{
+    return cancelled && *cancelled;
+}
+
+//QFile buffer the written data, the failure of writing the buffer is
+//only reported by flush and close
+bool close_output(QFile &outfile)
+{
+    bool const flushed = outfile.flush();
+    outfile.close();
+
+    return flushed && outfile.error() == QFileDevice::NoError;
+}
+
+//The old format is a qCompress blob which begin with the uncompressed
+//size, it may equal to the magic by chance. The fields after the magic
+//must be valid too, else the file is treated as the old format
+bool is_stream_header(QByteArray const &header)
+{
+    QDataStream in(header);
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint32 block_size = 0;
+    quint8 id = static_cast<quint8>(codec_id::zlib);
+    in>>magic>>version>>block_size;
+    if(version >= 3){
+        in>>id;
+    }
+
+    return in.status() == QDataStream::Ok && magic == stream_magic &&
+            version >= 1 && version <= stream_version &&
+            block_size > 0 && block_size <= static_cast<quint32>(max_stream_block_size) &&
+            find_codec(static_cast<codec_id>(id));
+}
+
+bool decompress_stream(QFile &infile, QFile &outfile, int thread_count,
+                       std::atomic<bool> const *cancelled)
+{
+    QDataStream in(&infile);
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint32 block_size = 0;
+    quint8 id = static_cast<quint8>(codec_id::zlib);
+    in>>magic>>version>>block_size;
+    if(version >= 3){
+        in>>id;
+    }
+    codec const *block_codec = find_codec(static_cast<codec_id>(id));
+    if(in.status() != QDataStream::Ok || version > stream_version || !block_codec ||
+            block_size == 0 || block_size > static_cast<quint32>(max_stream_block_size)){
+        return false;
+    }
+
+    std::vector<block> blocks(static_cast<size_t>(thread_count) * 2);
+    uchar const *mapped = map_file(infile);
+    auto read = [&](block &blk, bool &end_of_stream)
+    {
+        if(is_cancelled(cancelled)){
+            return false;
+        }
+        quint8 flags = 0;
+        quint32 raw_size = 0;
+        quint32 packed_size = 0;
+        if(version >= 2){
+            in>>flags;
+        }
+        in>>raw_size>>packed_size;
+        if(in.status() != QDataStream::Ok){
+            return false;
+        }
+        if(raw_size == 0){
+            end_of_stream = true;
+            return true;
+        }
+        if(raw_size > block_size || packed_size > max_packed_block_size(block_size)){
+            return false;
+        }
+
+        blk.raw_size_ = raw_size;
+        blk.stored_ = (flags & block_stored) != 0;
+        if(mapped){
+            qint64 const pos = infile.pos();
+            if(in.skipRawData(static_cast<int>(packed_size)) != static_cast<int>(packed_size)){
+                return false;
+            }
+            blk.packed_ = QByteArray::fromRawData(reinterpret_cast<char const*>(mapped + pos),
+                                                  static_cast<int>(packed_size));
+            return true;
+        }
+
+        blk.packed_.resize(static_cast<int>(packed_size));
+        return in.readRawData(blk.packed_.data(), blk.packed_.size()) == blk.packed_.size();
+    };
+    auto process = [block_codec, cancelled](block &blk)
+    {
+        if(is_cancelled(cancelled)){
+            blk.raw_.clear();
+            return;
+        }
+        blk.raw_ = blk.stored_ ? blk.packed_ :
+                                 block_codec->decompress(blk.packed_.constData(),
+                                                         blk.packed_.size(),
+                                                         static_cast<int>(blk.raw_size_));
+    };
+    auto write = [&outfile](block const &blk)
+    {
+        return blk.raw_.size() == static_cast<int>(blk.raw_size_) &&
+                outfile.write(blk.raw_) == blk.raw_.size();
+    };
+
+    return pipeline_blocks(thread_count, blocks, read, process, write);
+}
+
+//adaptive is nullptr if the level is fixed
+bool compress_file(QString const &file_name, QString const &compress_file_name,
+                   int compression_level, adaptive_level *adaptive,
+                   int block_size, int thread_count, codec_id codec_type,
+                   std::atomic<bool> const *cancelled)
+{
+    codec const *block_codec = find_codec(codec_type);
+    if(!block_codec || block_size <= 0 || block_size > max_stream_block_size){
+        return false;
+    }
+
     QFile infile(file_name);
     QFile outfile(compress_file_name);
     bool can_open = infile.open(QIODevice::ReadOnly);
@@ -20,14 +262,99 @@ bool compress(QString const &file_name, QString const &compress_file_name,
     if(!can_open){
         return false;
     }
-    QByteArray uncompressed_data = infile.readAll();
-    QByteArray compressed_data = qCompress(uncompressed_data, compression_level);
-    outfile.write(compressed_data);
 
-    return true;
+    //every thread got two blocks, the memory usage is bounded by
+    //4 * thread_count * block_size, no matter how big the file is.
+    //If the file can be mapped, the blocks refer to the mapped pages
+    //and the input is never copied
+    thread_count = resolve_thread_count(thread_count);
+    std::vector<block> blocks(static_cast<size_t>(thread_count) * 2);
+    uchar const *mapped = map_file(infile);
+    qint64 const file_size = infile.size();
+    qint64 map_pos = 0;
+    if(adaptive){
+        adaptive->start(file_size, thread_count, block_codec->max_level());
+    }
+
+    QDataStream out(&outfile);
+    out<<stream_magic<<stream_version<<static_cast<quint32>(block_size)
+      <<static_cast<quint8>(codec_type);
+    auto read = [&](block &blk, bool &end_of_file)
+    {
+        if(is_cancelled(cancelled)){
+            return false;
+        }
+        blk.level_ = adaptive ? adaptive->level() : compression_level;
+        if(mapped){
+            qint64 const read_size = std::min<qint64>(block_size, file_size - map_pos);
+            end_of_file = read_size == 0;
+            blk.raw_ = QByteArray::fromRawData(reinterpret_cast<char const*>(mapped + map_pos),
+                                               static_cast<int>(read_size));
+            map_pos += read_size;
+            return true;
+        }
+
+        blk.raw_.resize(block_size);
+        qint64 const read_size = infile.read(blk.raw_.data(), block_size);
+        if(read_size < 0){
+            return false;
+        }
+        end_of_file = read_size == 0;
+        blk.raw_.resize(static_cast<int>(read_size));
+        return true;
+    };
+    auto process = [block_codec, adaptive, cancelled](block &blk)
+    {
+        if(is_cancelled(cancelled)){
+            return;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        blk.stored_ = pack_block(*block_codec, blk.raw_, blk.level_, blk.packed_);
+        if(adaptive){
+            adaptive->report(blk.level_, blk.raw_.size(), timer.nsecsElapsed());
+        }
+    };
+    auto write = [&out, cancelled](block const &blk)
+    {
+        if(is_cancelled(cancelled)){//the block is not packed
+            return false;
+        }
+        out<<static_cast<quint8>(blk.stored_ ? block_stored : 0)
+          <<static_cast<quint32>(blk.raw_.size())
+          <<static_cast<quint32>(blk.packed_.size());
+        out.writeRawData(blk.packed_.constData(), blk.packed_.size());
+
+        return out.status() == QDataStream::Ok;
+    };
+    if(!pipeline_blocks(thread_count, blocks, read, process, write)){
+        return false;
+    }
+    out<<quint8(0)<<quint32(0)<<quint32(0);
+
+    return out.status() == QDataStream::Ok && close_output(outfile);
+}
+
 }
 
-bool decompress(QString const &file_name, QString const &decompress_file_name)
+bool compress(QString const &file_name, QString const &compress_file_name,
+              int compression_level, int block_size, int thread_count,
+              codec_id codec_type, std::atomic<bool> const *cancelled)
+{
+    return compress_file(file_name, compress_file_name, compression_level, nullptr,
+                         block_size, thread_count, codec_type, cancelled);
+}
+
+bool compress(QString const &file_name, QString const &compress_file_name,
+              adaptive_level &level, int block_size, int thread_count,
+              codec_id codec_type, std::atomic<bool> const *cancelled)
+{
+    return compress_file(file_name, compress_file_name, 0, &level,
+                         block_size, thread_count, codec_type, cancelled);
+}
+
+bool decompress(QString const &file_name, QString const &decompress_file_name,
+                int thread_count, std::atomic<bool> const *cancelled)
 {
     QFile infile(file_name);
     QFile outfile(decompress_file_name);
@@ -39,11 +366,12 @@ bool decompress(QString const &file_name, QString const &decompress_file_name)
     if(!can_open){
         return false;
     }
-    QByteArray uncompressed_data = infile.readAll();
-    QByteArray compressed_data = qUncompress(uncompressed_data);
-    outfile.write(compressed_data);
 
-    return true;
+    bool const success = is_stream_header(infile.peek(stream_header_size(stream_version))) ?
+                decompress_stream(infile, outfile, resolve_thread_count(thread_count), cancelled) :
+                decompress_legacy(infile, outfile);
+
+    return close_output(outfile) && success;
 }
 
-}}	
+}}
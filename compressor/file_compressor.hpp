@@ -1,5 +1,9 @@
+#include "codec.hpp"
+
 #include <QString>
 
+#include <atomic>
+
 /**
  *The codes come from http://www.antonioborondo.com/2014/10/22/zipping-and-unzipping-files-with-qt/
  */
@@ -8,9 +12,53 @@ namespace qte{
 
 namespace cp{
 
+class adaptive_level;
+
+/**
+ * Compress the file as a stream of independent blocks, only a few blocks
+ * of the input stay in the memory, so the memory usage do not grow
+ * with the size of the file. The blocks which cannot shrink(jpeg, zip etc)
+ * are stored without compression
+ * @param file_name the file want to compress
+ * @param compress_file_name the file to save the compressed data
+ * @param compressionLevel compression level, range from 0 to 9 for zlib
+ * @param block_size size of each block before compression, must be
+ * larger than 0 and no larger than 64MB
+ * @param thread_count number of threads used to compress the blocks,
+ * value <= 0 means QThread::idealThreadCount(). The output is the same
+ * no matter how many threads are used
+ * @param codec_type compression algorithm, it is recorded in the header of
+ * the output, fail if the codec is not available in this build
+ * @param cancelled checked before every block, the function return false
+ * once it is set, nullptr if the call cannot be cancelled
+ * @return true if success and vice versa
+ */
+bool compress(QString const &file_name, QString const &compress_file_name,
+               int compressionLevel = 9, int block_size = 1024 * 1024,
+               int thread_count = 1, codec_id codec_type = codec_id::zlib,
+               std::atomic<bool> const *cancelled = nullptr);
+
+/**
+ * Same as compress, but the level of every block is chosen by level to
+ * meet its throughput or deadline target
+ * @param level measure the speed of the blocks and choose the level, it
+ * must outlive the call
+ */
 bool compress(QString const &file_name, QString const &compress_file_name,
-               int compressionLevel = 9);
-bool decompress(QString const &file_name, QString const &decompress_file_name);
+              adaptive_level &level, int block_size = 1024 * 1024,
+              int thread_count = 1, codec_id codec_type = codec_id::zlib,
+              std::atomic<bool> const *cancelled = nullptr);
+
+/**
+ * Decompress the file created by compress, also able to decompress
+ * the file which compressed by qCompress as a single blob
+ * @param thread_count number of threads used to decompress the blocks,
+ * value <= 0 means QThread::idealThreadCount()
+ * @param cancelled same as compress
+ * @return true if success and vice versa
+ */
+bool decompress(QString const &file_name, QString const &decompress_file_name,
+                int thread_count = 1, std::atomic<bool> const *cancelled = nullptr);
 	
 }
 }	
@@ -1,12 +1,308 @@
 #include "folder_compressor.hpp"
+#include "adaptive_level.hpp"
+#include "checksum.hpp"
+#include "compressibility.hpp"
+#include "folder_scanner.hpp"
 
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <limits>
+#include <map>
 #include <set>
 
 namespace qte{
 
 namespace cp{
 
-folder_compressor::folder_compressor()
+namespace{
+
+int resolve_thread_count(int thread_count)
+{
+    return thread_count > 0 ? thread_count :
+                              std::max(1, QThread::idealThreadCount());
+}
+
+bool uncompress_entry(QByteArray const &packed, archive_entry const &entry,
+                      QByteArray &data)
+{
+    QByteArray unpacked;
+    return unpack_entry_data(packed, entry, unpacked) &&
+            slice_entry_data(unpacked, entry, data);
+}
+
+//Map the file into memory to avoid copying it into heap, fall back
+//to read the file if it cannot be mapped. The result is valid as long
+//as the file is open, the file larger than a QByteArray is not read
+QByteArray map_file(QFile &file)
+{
+    qint64 const size = file.size();
+    if(size > std::numeric_limits<int>::max()){
+        return {};
+    }
+    if(size > 0){
+        if(uchar const *mapped = file.map(0, size)){
+            return QByteArray::fromRawData(reinterpret_cast<char const*>(mapped),
+                                           static_cast<int>(size));
+        }
+    }
+
+    return file.readAll();
+}
+
+//Refer to the compressed data of the entry in the mapped archive
+//without copying, read it from the device if the archive is not mapped
+QByteArray entry_data(QIODevice &device, uchar const *mapped,
+                      archive_entry const &entry)
+{
+    if(mapped){
+        return QByteArray::fromRawData(reinterpret_cast<char const*>(mapped + entry.offset_),
+                                       static_cast<int>(entry.packed_size_));
+    }
+
+    return read_archive_entry(device, entry);
+}
+
+//Map the whole archive, return nullptr if it cannot be mapped
+uchar const* map_archive(QFile &file)
+{
+    qint64 const size = file.size();
+    if(size <= 0 || static_cast<quint64>(size) > std::numeric_limits<size_t>::max()){
+        return nullptr;
+    }
+
+    return file.map(0, size);
+}
+
+bool copy_data(QIODevice &from, qint64 offset, qint64 size, QDataStream &to)
+{
+    if(!from.seek(offset)){
+        return false;
+    }
+
+    qint64 const buffer_size = 1024 * 1024;
+    QByteArray buffer(static_cast<int>(std::min(size, buffer_size)), Qt::Uninitialized);
+    while(size > 0){
+        int const read_size = static_cast<int>(std::min(size, buffer_size));
+        if(from.read(buffer.data(), read_size) != read_size ||
+                to.writeRawData(buffer.constData(), read_size) != read_size){
+            return false;
+        }
+        size -= read_size;
+    }
+
+    return true;
+}
+
+bool create_folders(QString const &destinationFolder,
+                    std::vector<archive_entry> const &entries)
+{
+    //many files share the same folder, collect the folders first so
+    //every folder only need to be created once
+    std::set<QString> folders;
+    for(auto const &entry : entries){
+        int const separator = std::max(entry.name_.lastIndexOf('/'),
+                                       entry.name_.lastIndexOf('\\'));
+        if(separator > 0){
+            folders.insert(entry.name_.left(separator));
+        }
+    }
+
+    QDir dir;
+    for(auto const &folder : folders){
+        if(!dir.mkpath(destinationFolder + "/" + folder)){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//The archive is read sequentially by the caller, the entries are handed
+//to func(packed, first, last) on the thread pool. The entries are sorted
+//by the position of their data first, so the entries of the same solid
+//block or the same deduplicated data become adjacent. They share the
+//compressed data and are handed over together so the data is read and
+//uncompressed once. The reader wait if the compressed and uncompressed
+//bytes in flight exceed the limit. If the archive can be mapped, func
+//get the data from the mapped pages without copying. Stop at the first
+//failure of func, when progress return false or cancelled is set, the
+//groups not yet started are skipped
+template<typename Func>
+bool process_entries(QFile &archive, std::vector<archive_entry> &entries,
+                     int thread_count, qint64 max_bytes_in_flight,
+                     folder_compressor::progress_callback const &progress,
+                     std::atomic<bool> const &cancelled, Func func)
+{
+    //the copies of deduplicated data are far from the first entry in the
+    //directory, stable sort keep the order of the entries in solid block
+    std::stable_sort(std::begin(entries), std::end(entries),
+                     [](archive_entry const &lhs, archive_entry const &rhs)
+    {
+        return lhs.offset_ != rhs.offset_ ? lhs.offset_ < rhs.offset_ :
+                                            lhs.packed_size_ < rhs.packed_size_;
+    });
+    qint64 total_bytes = 0;
+    for(auto const &entry : entries){
+        total_bytes += entry.raw_size_;
+    }
+    qint64 done_bytes = 0;
+    qint64 done_files = 0;
+    qint64 const total_files = static_cast<qint64>(entries.size());
+    if(progress && !progress(0, total_bytes, 0, total_files)){
+        return false;
+    }
+
+    uchar const *mapped = map_archive(archive);
+    QMutex mutex;
+    QWaitCondition bytes_released;
+    qint64 bytes_in_flight = 0;
+    bool success = true;
+    auto process = [&](QByteArray const &packed, size_t first, size_t last,
+            qint64 group_bytes)
+    {
+        bool const processed = !cancelled && func(packed, first, last);
+
+        QMutexLocker lock(&mutex);
+        success = success && processed;
+        for(size_t i = first; i != last; ++i){
+            done_bytes += entries[i].raw_size_;
+        }
+        done_files += static_cast<qint64>(last - first);
+        if(success && progress){
+            success = progress(done_bytes, total_bytes, done_files, total_files);
+        }
+        bytes_in_flight -= group_bytes;
+        bytes_released.wakeAll();
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(thread_count);
+    for(size_t first = 0; first != entries.size();){
+        size_t last = first + 1;
+        while(last != entries.size() &&
+              entries[last].offset_ == entries[first].offset_ &&
+              entries[last].packed_size_ == entries[first].packed_size_){
+            ++last;
+        }
+
+        auto const &entry = entries[first];
+        qint64 const group_bytes = entry.packed_size_ +
+                ((entry.flags_ & entry_solid) ? entry.solid_size_ : entry.raw_size_);
+        {
+            QMutexLocker lock(&mutex);
+            while(success && bytes_in_flight > 0 &&
+                  bytes_in_flight + group_bytes > max_bytes_in_flight){
+                bytes_released.wait(&mutex);
+            }
+            if(!success || cancelled){
+                break;
+            }
+            bytes_in_flight += group_bytes;
+        }
+
+        QByteArray const packed = entry_data(archive, mapped, entry);
+        if(thread_count == 1){
+            process(packed, first, last, group_bytes);
+        }else{
+            pool.start([packed, first, last, group_bytes, &process]()
+            {
+                process(packed, first, last, group_bytes);
+            });
+        }
+        first = last;
+    }
+    pool.waitForDone();
+
+    return success && !cancelled;
+}
+
+
+//The file is the same as the entry if their size and checksum are
+//the same, the entry without checksum is always treated as changed
+bool same_file(QString const &path, archive_entry const &entry)
+{
+    QFileInfo const info(path);
+    if(!entry.has_checksum_ || !info.isFile() || info.size() != entry.raw_size_){
+        return false;
+    }
+
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) &&
+            crc32c(map_file(file)) == entry.checksum_;
+}
+
+//Compare the files under the folder with the entries on the thread
+//pool, the entries differ from the files are copied into changed
+void select_changed_files(QString const &destinationFolder,
+                          std::vector<archive_entry> const &entries,
+                          int thread_count, std::vector<archive_entry> &changed)
+{
+    //each task mark the entry it own so no lock is needed
+    std::vector<char> unchanged(entries.size(), 0);
+    {
+        QThreadPool pool;
+        pool.setMaxThreadCount(thread_count);
+        for(size_t i = 0; i != entries.size(); ++i){
+            auto compare = [&destinationFolder, &entries, &unchanged, i]()
+            {
+                unchanged[i] = same_file(destinationFolder + "/" + entries[i].name_,
+                                         entries[i]);
+            };
+            if(thread_count == 1){
+                compare();
+            }else{
+                pool.start(compare);
+            }
+        }
+    }
+
+    for(size_t i = 0; i != entries.size(); ++i){
+        if(!unchanged[i]){
+            changed.push_back(entries[i]);
+        }
+    }
+}
+
+//Remove the files under the folder which are not in the entries
+bool remove_files_not_in(QString const &destinationFolder,
+                         std::vector<archive_entry> const &entries)
+{
+    std::set<QString> names;
+    for(auto const &entry : entries){
+        names.insert(entry.name_);
+    }
+
+    std::vector<scanned_file> files;
+    folder_scanner().scan(destinationFolder, files);
+    for(auto const &file : files){
+        if(names.find(file.name_) == std::end(names) && !QFile::remove(file.path_)){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
+folder_compressor::folder_compressor() :
+    adaptive_(nullptr),
+    cancelled_(false),
+    codec_(codec_id::zlib),
+    deduplicate_(false),
+    max_bytes_in_flight_(64 * 1024 * 1024),
+    solid_block_size_(0),
+    thread_count_(1),
+    thread_count_set_(false)
 {
 }
 
@@ -22,6 +318,106 @@ bool folder_compressor::compress_folder(const QString &sourceFolder,
                                         const QStringList &exclude_content,
                                         int compression_level)
 {
+    return compress_archive(sourceFolder, destinationFile, exclude_content,
+                            compression_level, {}, nullptr);
+}
+
+bool folder_compressor::append_files(QString const &archiveFile,
+                                     QString const &sourceFolder,
+                                     QStringList const &files,
+                                     int compression_level)
+{
+    cancelled_ = false;
+    QDir const src(sourceFolder);
+    std::vector<file_entry> entries;
+    std::set<QString> names;
+    for(auto const &file : files){
+        QFileInfo const info(src.absoluteFilePath(file));
+        //the file outside of the folder has ".." component, but "..foo"
+        //is a legal name
+        QString const relative = src.relativeFilePath(info.absoluteFilePath());
+        if(!info.isFile() || relative == ".." || relative.startsWith("../") ||
+                QDir::isAbsolutePath(relative)){
+            return false;
+        }
+
+        file_entry entry;
+        entry.name_ = "/" + relative;
+        entry.path_ = info.absoluteFilePath();
+        entry.mtime_ = info.lastModified().toMSecsSinceEpoch();
+        entry.size_ = info.size();
+        if(names.insert(entry.name_).second){
+            entries.emplace_back(std::move(entry));
+        }
+    }
+
+    //ReadWrite would create an empty file, which is not an archive
+    file_.setFileName(archiveFile);
+    if(!file_.exists() || !file_.open(QIODevice::ReadWrite)){
+        return false;
+    }
+
+    //the new data and central directory are written after the old
+    //archive, the old central directory is left intact until the new
+    //one is complete. The old entries are kept in the index unless
+    //they are replaced
+    std::vector<archive_entry> index;
+    if(!seek_archive_append(file_, index)){
+        file_.close();
+        return false;
+    }
+    size_t const old_count = index.size();
+    qint64 const archive_end = file_.pos();
+    data_stream_.setDevice(&file_);
+    bool success = compress(entries, compression_level, {}, nullptr, index);
+    if(success){
+        index.erase(std::remove_if(std::begin(index), std::begin(index) + old_count,
+                                   [&](archive_entry const &entry)
+        {
+            return names.find(entry.name_) != std::end(names);
+        }), std::begin(index) + old_count);
+        success = finish_archive_append(file_, index);
+    }
+    if(!success){//the old archive end at archive_end
+        file_.resize(archive_end);
+    }
+    file_.close();
+
+    return success;
+}
+
+bool folder_compressor::
+compress_folder_incremental(QString const &sourceFolder,
+                            QString const &baselineFile,
+                            QString const &destinationFile,
+                            QStringList const &exclude_content,
+                            int compression_level)
+{
+    if(QFileInfo(baselineFile) == QFileInfo(destinationFile))
+    {//the baseline would be truncated before it is read
+        return false;
+    }
+
+    QFile baseline_file(baselineFile);
+    std::vector<archive_entry> baseline;
+    if(!baseline_file.open(QIODevice::ReadOnly) ||
+            !read_archive_index(baseline_file, baseline))
+    {
+        return false;
+    }
+
+    return compress_archive(sourceFolder, destinationFile, exclude_content,
+                            compression_level, baseline, &baseline_file);
+}
+
+bool folder_compressor::compress_archive(QString const &sourceFolder,
+                                         QString const &destinationFile,
+                                         QStringList const &exclude_content,
+                                         int compression_level,
+                                         std::vector<archive_entry> const &baseline,
+                                         QIODevice *baseline_device)
+{
+    cancelled_ = false;
     QDir src(sourceFolder);
     if(!src.exists())//folder not found
     {
@@ -36,68 +432,422 @@ bool folder_compressor::compress_folder(const QString &sourceFolder,
 
     data_stream_.setDevice(&file_);
 
-    bool success = compress(sourceFolder, "", exclude_content, compression_level);
+    std::vector<file_entry> entries;
+    scan(sourceFolder, exclude_content, entries);
+    std::vector<archive_entry> index;
+    bool const success = write_archive_header(file_) &&
+            compress(entries, compression_level, baseline, baseline_device, index) &&
+            write_archive_index(file_, index);
     file_.close();
+    if(!success){//an incomplete archive cannot be read
+        file_.remove();
+    }
 
     return success;
 }
 
-bool folder_compressor::compress(QString const &sourceFolder,
-                                 QString const &prefex,
-                                 int compression_level)
+bool folder_compressor::compress(std::vector<file_entry> &entries,
+                                 int compression_level,
+                                 std::vector<archive_entry> const &baseline,
+                                 QIODevice *baseline_device,
+                                 std::vector<archive_entry> &index)
 {
-    return compress(sourceFolder, prefex, {}, compression_level);
-}
-
-bool folder_compressor::compress(const QString &sourceFolder,
-                                 const QString &prefex,
-                                 const QStringList &exclude_content,
-                                 int compression_level)
-{
-    QDir dir(sourceFolder);
-    if(!dir.exists())
+    codec const *entry_codec = find_codec(codec_);
+    if(!entry_codec){
         return false;
+    }
 
-    //1 - list all folders inside the current folder
-    dir.setFilter(QDir::NoDotAndDotDot | QDir::Dirs);
-    QFileInfoList foldersList = dir.entryInfoList();
+    std::vector<compress_unit> units;
+    make_units(entries, baseline, units);
 
-    std::set<QString> exclude_set(std::begin(exclude_content),
-                                  std::end(exclude_content));
-    //2 - For each folder in list: call the same function with folders' paths
-    for(int i = 0; i < foldersList.length(); ++i)
+    QMutex mutex;
+    QWaitCondition unit_done;
+    //digest of content -> smallest index of the units with the content
+    std::map<QByteArray, size_t> blob_table;
+    bool const deduplicate = deduplicate_;
+    adaptive_level *adaptive = adaptive_;
+    std::atomic<bool> const *cancelled = &cancelled_;
+    auto compress_unit_data = [&mutex, &unit_done, &entries, &units, &blob_table,
+            deduplicate, entry_codec, adaptive, cancelled](compress_unit &unit)
     {
-        QString const folderName = foldersList.at(i).fileName();
-        if(exclude_set.find(folderName) == std::end(exclude_set)){
-            QString const folderPath = dir.absolutePath() + "/" + folderName;
-            QString const newPrefex = prefex + "/" + folderName;
-            compress(folderPath, newPrefex, compression_level);
+        //the files of solid unit are concatenated and compressed as one block,
+        //the unit with one file is compressed from the mapped file directly
+        bool const single = unit.last_ - unit.first_ == 1;
+        QFile single_file; //keep the mapped file alive until it is compressed
+        QByteArray raw;
+        if(!single){
+            raw.reserve(static_cast<int>(unit.size_));
+        }
+        bool success = true;
+        bool reused = unit.baseline_ != nullptr;
+        for(size_t i = unit.first_; i != unit.last_ && success; ++i){
+            QFile solid_file;
+            QFile &file = single ? single_file : solid_file;
+            file.setFileName(entries[i].path_);
+            success = !*cancelled && file.open(QIODevice::ReadOnly);
+            QByteArray const content = success ? map_file(file) : QByteArray();
+            //the file too large or changed after it is scanned is read
+            //short, the size recorded must be the size compressed
+            success = success && content.size() == entries[i].size_;
+            if(success){
+                entries[i].checksum_ = crc32c(content);
+                entries[i].raw_size_ = content.size();
+                if(single){
+                    raw = content;
+                }else{
+                    raw += content;
+                }
+                //the compressed data of baseline can be copied only if the
+                //content of every file in the unit is unchanged
+                reused = reused && entries[i].baseline_ &&
+                        entries[i].raw_size_ == entries[i].baseline_->raw_size_ &&
+                        entries[i].checksum_ == entries[i].baseline_->checksum_;
+            }
+        }
+
+        //identical content is stored once, the unit with the smallest
+        //index own the data and the others refer to it
+        //a big file take long to checksum, check again before compress it
+        success = success && !*cancelled;
+        QByteArray digest;
+        bool duplicated = false;
+        if(success && deduplicate && !unit.solid_){
+            digest = QCryptographicHash::hash(raw, QCryptographicHash::Sha256);
+            size_t const unit_index = static_cast<size_t>(&unit - units.data());
+            QMutexLocker lock(&mutex);
+            auto it = blob_table.find(digest);
+            if(it == std::end(blob_table)){
+                blob_table.emplace(digest, unit_index);
+            }else if(it->second < unit_index){
+                duplicated = true;
+            }else{
+                it->second = unit_index;
+            }
+        }
+
+        QByteArray data;
+        bool stored = false;
+        qint64 compress_nsecs = 0; //0 if the codec is not called
+        if(success && !reused && !duplicated){
+            //the files like jpeg, mp4 or zip cannot shrink, store them as is
+            stored = !is_compressible(raw.constData(), raw.size());
+            if(!stored){
+                QElapsedTimer timer;
+                timer.start();
+                data = entry_codec->compress(raw.constData(), raw.size(), unit.level_);
+                compress_nsecs = timer.nsecsElapsed();
+                stored = data.isEmpty() || data.size() >= raw.size();
+            }
+            if(stored){
+                //the mapped file is unmapped when this function return
+                data = single ? QByteArray(raw.constData(), raw.size()) : raw;
+            }
+        }
+        if(adaptive){
+            adaptive->report(unit.level_, raw.size(), compress_nsecs);
         }
-    }
 
-    //3 - List all files inside the current folder
-    dir.setFilter(QDir::NoDotAndDotDot | QDir::Files);
-    QFileInfoList filesList = dir.entryInfoList();
+        QMutexLocker lock(&mutex);
+        unit.data_ = data;
+        unit.digest_ = digest;
+        unit.raw_size_ = raw.size();
+        unit.reused_ = reused;
+        unit.stored_ = stored;
+        unit.success_ = success;
+        unit.done_ = true;
+        unit_done.wakeAll();
+    };
 
-    //4- For each file in list: add file path and compressed binary data
-    for(int i=0; i<filesList.length(); i++)
+    int const thread_count = resolve_thread_count(thread_count_);
+    QThreadPool pool;
+    pool.setMaxThreadCount(thread_count);
+    size_t next_submit = 0;
+    qint64 bytes_in_flight = 0;
+    //the units before next_write are written, report them and check
+    //whether the caller want to cancel
+    qint64 total_bytes = 0;
+    for(auto const &unit : units){
+        total_bytes += unit.size_;
+    }
+    if(adaptive_){
+        adaptive_->start(total_bytes, thread_count, entry_codec->max_level());
+    }
+    qint64 done_bytes = 0;
+    qint64 done_files = 0;
+    auto report_progress = [&](size_t next_write)
     {
-        QFile file(dir.absolutePath()+"/"+filesList.at(i).fileName());
-        if(!file.open(QIODevice::ReadOnly))//couldn't open file
+        if(next_write != 0){
+            auto const &unit = units[next_write - 1];
+            done_bytes += unit.size_;
+            done_files += static_cast<qint64>(unit.last_ - unit.first_);
+        }
+        return !progress_ ||
+                progress_(done_bytes, total_bytes, done_files,
+                          static_cast<qint64>(entries.size()));
+    };
+    for(size_t next_write = 0; next_write != units.size(); ++next_write){
+        if(cancelled_ || !report_progress(next_write)){//cancelled at the unit boundary
+            pool.clear();
+            pool.waitForDone();
+            return false;
+        }
+
+        //keep the workers busy until the bytes in flight reach the limit,
+        //at least one unit must be in flight or the writer would wait forever
+        while(next_submit != units.size() &&
+              (next_submit == next_write || bytes_in_flight < max_bytes_in_flight_)){
+            compress_unit *unit = &units[next_submit++];
+            unit->level_ = adaptive_ ? adaptive_->level() : compression_level;
+            bytes_in_flight += unit->size_;
+            if(thread_count == 1){
+                compress_unit_data(*unit);
+            }else{
+                pool.start([unit, compress_unit_data]()
+                {
+                    compress_unit_data(*unit);
+                });
+            }
+        }
+
+        //the writer is the only one who touch the archive, the units
+        //are written in the order of scan, so the archive is the same no
+        //matter how many threads are used
+        auto &unit = units[next_write];
         {
+            QMutexLocker lock(&mutex);
+            while(!unit.done_){
+                unit_done.wait(&mutex);
+            }
+        }
+        if(unit.success_ && !unit.digest_.isEmpty()){
+            //all of the units before this one are written, so the owner
+            //of the content is decided and already in the archive
+            size_t owner = next_write;
+            {
+                QMutexLocker lock(&mutex);
+                owner = blob_table[unit.digest_];
+            }
+            if(owner != next_write){
+                archive_entry index_entry = index[units[owner].index_position_];
+                index_entry.mtime_ = entries[unit.first_].mtime_;
+                index_entry.name_ = entries[unit.first_].name_;
+                index.emplace_back(std::move(index_entry));
+                unit.data_.clear();
+                bytes_in_flight -= unit.size_;
+                continue;
+            }
+        }
+
+        unit.index_position_ = index.size();
+        qint64 const offset = file_.pos();
+        bool written = false;
+        if(unit.success_ && unit.reused_){
+            written = copy_data(*baseline_device, unit.baseline_->offset_,
+                                unit.baseline_->packed_size_, data_stream_);
+        }else if(unit.success_){
+            written = data_stream_.writeRawData(unit.data_.constData(), unit.data_.size()) ==
+                    unit.data_.size();
+        }
+        if(!written){//couldn't open file or write archive
+            pool.clear();
+            pool.waitForDone();
             return false;
         }
 
-        data_stream_ << QString(prefex+"/"+filesList.at(i).fileName());
-        data_stream_ << qCompress(file.readAll(), compression_level);
+        if(unit.reused_){
+            //the files share the same compressed data of the baseline, only
+            //the position of the data is changed
+            for(size_t i = unit.first_; i != unit.last_; ++i){
+                archive_entry index_entry = *entries[i].baseline_;
+                index_entry.mtime_ = entries[i].mtime_;
+                index_entry.offset_ = offset;
+                index.emplace_back(std::move(index_entry));
+            }
+            bytes_in_flight -= unit.size_;
+            continue;
+        }
+
+        //all of the files in the same unit share the compressed data
+        qint64 solid_offset = 0;
+        for(size_t i = unit.first_; i != unit.last_; ++i){
+            archive_entry index_entry;
+            index_entry.checksum_ = entries[i].checksum_;
+            index_entry.codec_ = codec_;
+            index_entry.flags_ = static_cast<quint8>((unit.stored_ ? entry_stored : 0) |
+                                                     (unit.solid_ ? entry_solid : 0));
+            index_entry.has_checksum_ = true;
+            index_entry.mtime_ = entries[i].mtime_;
+            index_entry.name_ = entries[i].name_;
+            index_entry.offset_ = offset;
+            index_entry.packed_size_ = unit.data_.size();
+            index_entry.raw_size_ = entries[i].raw_size_;
+            if(unit.solid_){
+                index_entry.solid_offset_ = solid_offset;
+                index_entry.solid_size_ = unit.raw_size_;
+                solid_offset += entries[i].raw_size_;
+            }
+            index.emplace_back(std::move(index_entry));
+        }
+        unit.data_.clear();
+        bytes_in_flight -= unit.size_;
+    }
+    if(!units.empty()){
+        report_progress(units.size());
     }
 
     return true;
 }
 
+void folder_compressor::make_units(std::vector<file_entry> &entries,
+                                   std::vector<archive_entry> const &baseline,
+                                   std::vector<compress_unit> &units) const
+{
+    std::map<QString, size_t> baseline_table;
+    for(size_t i = 0; i != baseline.size(); ++i){
+        baseline_table.emplace(baseline[i].name_, i);
+    }
+    //size and modification time are the same as the baseline, the
+    //checksum is verified by the workers since it need to read the file
+    auto unchanged = [&](size_t entry, size_t base)
+    {
+        return baseline[base].has_checksum_ && baseline[base].mtime_ != 0 &&
+                entries[entry].size_ == baseline[base].raw_size_ &&
+                entries[entry].mtime_ == baseline[base].mtime_;
+    };
+    auto same_blob = [&](size_t lhs, size_t rhs)
+    {
+        return baseline[lhs].offset_ == baseline[rhs].offset_ &&
+                baseline[lhs].packed_size_ == baseline[rhs].packed_size_;
+    };
+
+    for(size_t i = 0; i != entries.size();){
+        //the compressed data of baseline could be reused if every entry
+        //sharing it is unchanged and still in the same order
+        auto it = baseline_table.find(entries[i].name_);
+        if(it != std::end(baseline_table) &&
+                (it->second == 0 || !same_blob(it->second - 1, it->second))){
+            size_t const first = it->second;
+            size_t count = 0;
+            while(first + count != baseline.size() && i + count != entries.size() &&
+                  same_blob(first, first + count) &&
+                  entries[i + count].name_ == baseline[first + count].name_ &&
+                  unchanged(i + count, first + count)){
+                ++count;
+            }
+            if(count > 0 && (first + count == baseline.size() ||
+                             !same_blob(first, first + count))){
+                compress_unit unit;
+                unit.baseline_ = &baseline[first];
+                unit.first_ = i;
+                unit.last_ = i + count;
+                unit.solid_ = count > 1;
+                for(size_t j = 0; j != count; ++j){
+                    entries[i + j].baseline_ = &baseline[first + j];
+                    unit.size_ += entries[i + j].size_;
+                }
+                units.emplace_back(std::move(unit));
+                i += count;
+                continue;
+            }
+        }
+
+        //pack the small files into solid units if solid mode is enabled,
+        //every other file is a unit by itself
+        qint64 const size = entries[i].size_;
+        bool const small_file = solid_block_size_ > 0 && size < solid_block_size_;
+        if(small_file && !units.empty() && units.back().solid_ &&
+                !units.back().baseline_ &&
+                units.back().size_ + size <= solid_block_size_){
+            units.back().last_ = i + 1;
+            units.back().size_ += size;
+        }else{
+            compress_unit unit;
+            unit.first_ = i;
+            unit.last_ = i + 1;
+            unit.size_ = size;
+            unit.solid_ = small_file;
+            units.emplace_back(std::move(unit));
+        }
+        ++i;
+    }
+    for(auto &unit : units){
+        //no need to pay the cost of slicing if there is only one file
+        unit.solid_ = unit.solid_ && unit.last_ - unit.first_ > 1;
+    }
+}
+
+void folder_compressor::scan(QString const &sourceFolder,
+                             QStringList const &exclude_content,
+                             std::vector<file_entry> &entries) const
+{
+    folder_scanner scanner(exclude_content);
+    scanner.set_thread_count(thread_count_);
+    std::vector<scanned_file> files;
+    scanner.scan(sourceFolder, files);
+
+    entries.reserve(entries.size() + files.size());
+    for(auto &file : files){
+        file_entry entry;
+        entry.mtime_ = file.mtime_;
+        entry.name_ = std::move(file.name_);
+        entry.path_ = std::move(file.path_);
+        entry.size_ = file.size_;
+        entries.emplace_back(std::move(entry));
+    }
+}
+
+void folder_compressor::set_adaptive_level(adaptive_level *value)
+{
+    adaptive_ = value;
+}
+
+void folder_compressor::set_codec(codec_id value)
+{
+    codec_ = value;
+}
+
+void folder_compressor::set_deduplicate(bool value)
+{
+    deduplicate_ = value;
+}
+
+void folder_compressor::set_max_bytes_in_flight(qint64 value)
+{
+    max_bytes_in_flight_ = value;
+}
+
+void folder_compressor::cancel()
+{
+    cancelled_ = true;
+}
+
+void folder_compressor::set_progress_callback(progress_callback value)
+{
+    progress_ = std::move(value);
+}
+
+void folder_compressor::set_solid_block_size(qint64 value)
+{
+    solid_block_size_ = value;
+}
+
+void folder_compressor::set_thread_count(int value)
+{
+    thread_count_ = value;
+    thread_count_set_ = true;
+}
+
 bool folder_compressor::decompress_folder(QString const &sourceFile,
                                           QString const &destinationFolder)
 {
+    return extract_folder(sourceFile, destinationFolder, false, false);
+}
+
+bool folder_compressor::extract_folder(QString const &sourceFile,
+                                       QString const &destinationFolder,
+                                       bool sync, bool remove_extra_files)
+{
+    cancelled_ = false;
     //validation
     QFile src(sourceFile);
     if(!src.exists())
@@ -114,40 +864,158 @@ bool folder_compressor::decompress_folder(QString const &sourceFile,
     if(!file_.open(QIODevice::ReadOnly))
         return false;
 
-    data_stream_.setDevice(&file_);
+    std::vector<archive_entry> entries;
+    if(!read_archive_index(file_, entries))
+    {
+        file_.close();
+        return false;
+    }
 
-    while(!data_stream_.atEnd())
+    //every folder is created once before the files are written
+    if(!create_folders(destinationFolder, entries))
     {
-        QString fileName;
-        QByteArray data;
+        file_.close();
+        return false;
+    }
 
-        //extract file name and data in order
-        data_stream_ >> fileName >> data;
+    int const thread_count = resolve_thread_count(thread_count_);
+    std::vector<archive_entry> all_entries;
+    if(sync)
+    {
+        //only the files differ from the index are extracted
+        std::vector<archive_entry> changed;
+        select_changed_files(destinationFolder, entries, thread_count, changed);
+        all_entries.swap(entries);
+        entries.swap(changed);
+    }
 
-        //create any needed folder
-        QString subfolder;
-        for(int i=fileName.length()-1; i>0; i--)
+    //the workers uncompress the data and write the files
+    bool const success = process_entries(
+                file_, entries, thread_count, max_bytes_in_flight_,
+                progress_, cancelled_, [&](QByteArray const &packed, size_t first, size_t last)
+    {
+        QByteArray unpacked;
+        bool extracted = unpack_entry_data(packed, entries[first], unpacked);
+        for(size_t i = first; i != last && extracted; ++i)
         {
-            if((QString(fileName.at(i)) == QString("\\")) || (QString(fileName.at(i)) == QString("/")))
+            QByteArray data;
+            extracted = slice_entry_data(unpacked, entries[i], data);
+            if(extracted)
             {
-                subfolder = fileName.left(i);
-                dir.mkpath(destinationFolder+"/"+subfolder);
-                break;
+                QFile outFile(destinationFolder+"/"+entries[i].name_);
+                extracted = outFile.open(QIODevice::WriteOnly) &&
+                        outFile.write(data) == data.size();
             }
         }
 
-        QFile outFile(destinationFolder+"/"+fileName);
-        if(!outFile.open(QIODevice::WriteOnly))
-        {
-            file_.close();
-            return false;
+        return extracted;
+    });
+
+    file_.close();
+    //the extra files are removed only if the archive is extracted, a
+    //corrupted archive must not cost the files of the folder
+    if(success && sync && remove_extra_files)
+    {
+        return remove_files_not_in(destinationFolder, all_entries);
+    }
+    return success;
+}
+
+bool folder_compressor::sync_folder(QString const &sourceFile,
+                                    QString const &destinationFolder,
+                                    bool remove_extra_files)
+{
+    return extract_folder(sourceFile, destinationFolder, true, remove_extra_files);
+}
+
+bool folder_compressor::extract_entry(QString const &sourceFile,
+                                      QString const &entry_name,
+                                      QString const &destinationFile) const
+{
+    QFile archive(sourceFile);
+    if(!archive.open(QIODevice::ReadOnly)){
+        return false;
+    }
+
+    std::vector<archive_entry> entries;
+    if(!read_archive_index(archive, entries)){
+        return false;
+    }
+
+    QString const name = entry_name.startsWith("/") ? entry_name : "/" + entry_name;
+    auto it = std::find_if(std::begin(entries), std::end(entries),
+                           [&](archive_entry const &entry)
+    {
+        return entry.name_ == name;
+    });
+    QByteArray data;
+    if(it == std::end(entries) ||
+            !uncompress_entry(entry_data(archive, map_archive(archive), *it), *it, data)){
+        return false;
+    }
+
+    QDir().mkpath(QFileInfo(destinationFile).absolutePath());
+    QFile outFile(destinationFile);
+    if(!outFile.open(QIODevice::WriteOnly)){
+        return false;
+    }
+
+    return outFile.write(data) == data.size();
+}
+
+bool folder_compressor::list_entries(QString const &sourceFile,
+                                     std::vector<archive_entry> &entries) const
+{
+    QFile archive(sourceFile);
+    if(!archive.open(QIODevice::ReadOnly)){
+        return false;
+    }
+
+    return read_archive_index(archive, entries);
+}
+
+bool folder_compressor::verify(QString const &sourceFile) const
+{
+    QStringList corrupted_entries;
+    return verify(sourceFile, corrupted_entries);
+}
+
+bool folder_compressor::verify(QString const &sourceFile,
+                               QStringList &corrupted_entries) const
+{
+    corrupted_entries.clear();
+    cancelled_ = false;
+    QFile archive(sourceFile);
+    std::vector<archive_entry> entries;
+    if(!archive.open(QIODevice::ReadOnly) || !read_archive_index(archive, entries)){
+        return false;
+    }
+
+    //nothing is written, the workers uncompress the data and compare the
+    //checksums only. Every entry is checked even if some of them fail,
+    //each worker mark the entries it own so no lock is needed
+    std::vector<char> corrupted(entries.size(), 0);
+    int const thread_count = resolve_thread_count(thread_count_set_ ? thread_count_ : 0);
+    bool const finished =
+            process_entries(archive, entries, thread_count,
+                            max_bytes_in_flight_, progress_, cancelled_,
+                            [&](QByteArray const &packed, size_t first, size_t last)
+    {
+        QByteArray unpacked;
+        bool const unpacked_ok = unpack_entry_data(packed, entries[first], unpacked);
+        for(size_t i = first; i != last; ++i){
+            QByteArray data;
+            corrupted[i] = !unpacked_ok || !slice_entry_data(unpacked, entries[i], data);
+        }
+        return true;
+    });
+    for(size_t i = 0; i != entries.size(); ++i){
+        if(corrupted[i]){
+            corrupted_entries.push_back(entries[i].name_);
         }
-        outFile.write(qUncompress(data));
-        outFile.close();
     }
 
-    file_.close();
-    return true;
+    return finished && corrupted_entries.isEmpty();
 }
 
 }}
@@ -1,44 +1,274 @@
 #ifndef FOLDERCOMPRESSOR_H
 #define FOLDERCOMPRESSOR_H
 
+#include "archive_index.hpp"
+#include "codec.hpp"
+
 #include <QDataStream>
 #include <QDir>
 #include <QFile>
 
+#include <atomic>
+#include <functional>
+#include <vector>
+
 namespace qte{
 
 namespace cp{
 
+class adaptive_level;
+
 /**
  * @brief This class come from http://3adly.blogspot.my/2011/06/qt-folder-compression.html
  */
 class folder_compressor
 {    
 public:
+    /**
+     * Called after every file or block is processed, return false to
+     * cancel the operation. The arguments are bytes processed, total
+     * bytes, files processed and total files
+     */
+    using progress_callback = std::function<bool(qint64, qint64, qint64, qint64)>;
+
     folder_compressor();
 
     //A recursive function that scans all files inside the source folder
-    //and serializes all files in a row of file names and compressed
-    //binary data in a single file
+    //and serializes all files in a row of compressed binary data, followed
+    //by a central directory which record the name and position of the files.
+    //exclude_content are the names or wildcards of the files and folders
+    //to skip at any depth, see folder_scanner
     bool compress_folder(QString const &sourceFolder, QString const &destinationFile,
                          int compression_level = 9);
     bool compress_folder(QString const &sourceFolder, QString const &destinationFile,
                          QStringList const &exclude_content,
                          int compression_level = 9);
 
+    /**
+     * Add files into the archive created by compress_folder, the new data
+     * is written after the data of the archive and only the central
+     * directory is rewritten, so the cost is proportional to the new files.
+     * The file with the same name in the archive is replaced, the space of
+     * its data and of the old central directory is not reclaimed. If fail,
+     * the archive is restored, if interrupted, the archive cannot be read
+     * until the next append, which continue from the archive as before
+     * the interrupted append. Fail if the archive do not exist
+     * @param archiveFile the archive
+     * @param sourceFolder the folder the files belong to, the names in
+     * the archive are relative to it
+     * @param files the files want to add, absolute or relative to sourceFolder
+     * @return true if success and vice versa
+     */
+    bool append_files(QString const &archiveFile, QString const &sourceFolder,
+                      QStringList const &files, int compression_level = 9);
+
+    /**
+     * Ask the running operation to stop, can be called from any thread.
+     * The flag is checked before every entry is read, checksummed and
+     * compressed, and before every group of entries is uncompressed, the
+     * operation return false the same as the progress callback return
+     * false. The flag is cleared when the next operation start
+     */
+    void cancel();
+
+    /**
+     * Same as compress_folder, but the files unchanged since the baseline
+     * archive(same size, modification time and checksum) are not compressed
+     * again, their compressed data are copied from the baseline. The new
+     * archive do not depend on the baseline
+     * @param sourceFolder the folder want to compress
+     * @param baselineFile the archive created from the same folder before,
+     * must not be the same file as destinationFile
+     * @param destinationFile where to save the archive
+     * @return true if success and vice versa
+     */
+    bool compress_folder_incremental(QString const &sourceFolder,
+                                     QString const &baselineFile,
+                                     QString const &destinationFile,
+                                     QStringList const &exclude_content = {},
+                                     int compression_level = 9);
+
     //A function that deserializes data from the compressed file and
-    //creates any needed subfolders before saving the file
+    //creates any needed subfolders before saving the files, the files
+    //are uncompressed and written on the thread pool
     bool decompress_folder(QString const &sourceFile, QString const &destinationFolder);
 
+    /**
+     * Same as decompress_folder, but the existing files with the same size
+     * and checksum as the archive are not written again, so extracting
+     * the archive over a mostly identical folder only read the files
+     * @param sourceFile the archive
+     * @param destinationFolder the folder want to update
+     * @param remove_extra_files true will remove the files of the folder
+     * which are not in the archive
+     * @return true if success and vice versa
+     */
+    bool sync_folder(QString const &sourceFile, QString const &destinationFolder,
+                     bool remove_extra_files = false);
+
+    /**
+     * Extract one file from the archive, only the central directory and
+     * the data of the file are read if the archive got central directory
+     * @param sourceFile the archive
+     * @param entry_name name of the file in the archive, same as the
+     * name_ of archive_entry
+     * @param destinationFile where to save the file
+     * @return true if success and vice versa
+     */
+    bool extract_entry(QString const &sourceFile, QString const &entry_name,
+                       QString const &destinationFile) const;
+
+    /**
+     * List the files of the archive without decompressing them
+     * @param sourceFile the archive
+     * @param entries information of the files in the archive
+     * @return true if success and vice versa
+     */
+    bool list_entries(QString const &sourceFile,
+                      std::vector<archive_entry> &entries) const;
+
+    /**
+     * Check the archive without writing any file, the entries are
+     * uncompressed on the thread pool and compared with their checksums.
+     * Every core is used unless set_thread_count is called. Memory usage
+     * is bounded by set_max_bytes_in_flight
+     * @param sourceFile the archive
+     * @param corrupted_entries names of the entries fail the check
+     * @return true if every entry is intact and vice versa
+     */
+    bool verify(QString const &sourceFile, QStringList &corrupted_entries) const;
+
+    /**
+     * Overload of verify(sourceFile, corrupted_entries)
+     */
+    bool verify(QString const &sourceFile) const;
+
+    /**
+     * Choose the level of every entry by value instead of the
+     * compression_level passed to compress_folder, so the compression
+     * meet the throughput or deadline target of value
+     * @param value the level selector, must outlive the compression,
+     * nullptr means fixed level. Default value is nullptr
+     */
+    void set_adaptive_level(adaptive_level *value);
+
+    /**
+     * Compression algorithm of compress_folder, the codec is recorded
+     * for every entry, fail to compress if the codec is not available
+     * in this build. Default value is codec_id::zlib
+     * @param value id of the codec
+     */
+    void set_codec(codec_id value);
+
+    /**
+     * If true, the files with identical content are stored once, the
+     * duplicated files refer to the data of the first one and are not
+     * compressed at all. decompress_folder restore every copy. Files in
+     * solid blocks are not deduplicated. Default value is false
+     * @param value enable or disable deduplication
+     */
+    void set_deduplicate(bool value);
+
+    /**
+     * Maximum bytes of the files which are read or compressed but not
+     * yet written into the archive(or into the files when decompress),
+     * this value bound the memory usage of compress_folder and
+     * decompress_folder. Default value is 64MB
+     * @param value maximum bytes in flight
+     */
+    void set_max_bytes_in_flight(qint64 value);
+
+    /**
+     * Report the progress of compress_folder, decompress_folder and
+     * verify. The callback may be called from the worker threads, but
+     * never concurrently. If the callback return false the operation
+     * stop at the next block and return false, the archive being
+     * compressed is removed, the files already decompressed are kept
+     * @param value the callback, empty by default
+     */
+    void set_progress_callback(progress_callback value);
+
+    /**
+     * Enable solid mode if value > 0, the files smaller than value are
+     * packed together and compressed as a block no larger than value.
+     * Small files got better compression ratio and speed in solid mode,
+     * extract one file only need to uncompress the block it belongs to.
+     * Default value is 0
+     * @param value size of the solid block
+     */
+    void set_solid_block_size(qint64 value);
+
+    /**
+     * Number of threads used to compress, decompress or verify the files,
+     * value <= 0 means QThread::idealThreadCount(). Default value is 1,
+     * except verify which use QThread::idealThreadCount() by default. The
+     * archive is the same no matter how many threads are used
+     * @param value number of threads
+     */
+    void set_thread_count(int value);
+
 private:    
-    bool compress(QString const &sourceFolder, QString const &prefex,
-                  int compression_level);
-    bool compress(QString const &sourceFolder, QString const &prefex,
-                  QStringList const &exclude_content,
-                  int compression_level);
+    struct file_entry
+    {
+        archive_entry const *baseline_ = nullptr; //same file in baseline archive
+        quint32 checksum_ = 0;
+        qint64 mtime_ = 0;
+        QString name_;
+        QString path_;
+        qint64 raw_size_ = 0;
+        qint64 size_ = 0;
+    };
+
+    //The files compressed together, every unit contains one file
+    //unless solid mode is enabled
+    struct compress_unit
+    {
+        //first entry of the baseline blob which may be reused by the unit
+        archive_entry const *baseline_ = nullptr;
+        QByteArray data_;
+        QByteArray digest_; //sha256 of the content if deduplicate is enabled
+        bool done_ = false;
+        size_t first_ = 0; //index of the first file
+        size_t index_position_ = 0; //position of the first file in index
+        size_t last_ = 0; //one past the index of the last file
+        int level_ = 9;
+        qint64 raw_size_ = 0;
+        bool reused_ = false; //the compressed data is copied from baseline
+        qint64 size_ = 0;
+        bool solid_ = false;
+        bool stored_ = false;
+        bool success_ = false;
+    };
+
+    //Read and compress the entries on the thread pool, then write them
+    //into the archive by the order of entries
+    bool compress(std::vector<file_entry> &entries, int compression_level,
+                  std::vector<archive_entry> const &baseline,
+                  QIODevice *baseline_device,
+                  std::vector<archive_entry> &index);
+    bool compress_archive(QString const &sourceFolder, QString const &destinationFile,
+                          QStringList const &exclude_content, int compression_level,
+                          std::vector<archive_entry> const &baseline,
+                          QIODevice *baseline_device);
+    bool extract_folder(QString const &sourceFile, QString const &destinationFolder,
+                        bool sync, bool remove_extra_files);
+    void make_units(std::vector<file_entry> &entries,
+                    std::vector<archive_entry> const &baseline,
+                    std::vector<compress_unit> &units) const;
+    void scan(QString const &sourceFolder, QStringList const &exclude_content,
+              std::vector<file_entry> &entries) const;
 
+    adaptive_level *adaptive_;
+    mutable std::atomic<bool> cancelled_;
+    codec_id codec_;
     QDataStream data_stream_;
+    bool deduplicate_;
     QFile file_;
+    qint64 max_bytes_in_flight_;
+    progress_callback progress_;
+    qint64 solid_block_size_;
+    int thread_count_;
+    bool thread_count_set_; //verify use all cores unless it is set
 };
 
 }}
@@ -0,0 +1,154 @@
+#include "folder_scanner.hpp"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+namespace qte{
+
+namespace cp{
+
+namespace{
+
+struct folder_node
+{
+    std::vector<std::unique_ptr<folder_node>> children_;
+    std::vector<scanned_file> files_;
+    QString name_;
+    QString path_;
+    QString prefix_; //name of the folder in the result
+};
+
+//same order as QDir::Name | QDir::IgnoreCase, the tie is broken by
+//case so the order is always the same
+bool name_less(QString const &lhs, QString const &rhs)
+{
+    int const result = QString::compare(lhs, rhs, Qt::CaseInsensitive);
+    return result != 0 ? result < 0 : lhs < rhs;
+}
+
+//List the folder once, both the files and sub folders are recorded
+void list_folder(folder_scanner const &scanner, folder_node &node)
+{
+    QDirIterator it(node.path_, QDir::NoDotAndDotDot | QDir::Dirs | QDir::Files);
+    while(it.hasNext()){
+        it.next();
+        QFileInfo const info = it.fileInfo();
+        QString const name = info.fileName();
+        if(scanner.is_excluded(name)){
+            continue;
+        }
+
+        if(info.isDir()){
+            std::unique_ptr<folder_node> child(new folder_node);
+            child->name_ = name;
+            child->path_ = node.path_ + "/" + name;
+            child->prefix_ = node.prefix_ + "/" + name;
+            node.children_.emplace_back(std::move(child));
+        }else{
+            scanned_file file;
+            file.mtime_ = info.lastModified().toMSecsSinceEpoch();
+            file.name_ = node.prefix_ + "/" + name;
+            file.path_ = node.path_ + "/" + name;
+            file.size_ = info.size();
+            node.files_.emplace_back(std::move(file));
+        }
+    }
+
+    std::sort(std::begin(node.children_), std::end(node.children_),
+              [](std::unique_ptr<folder_node> const &lhs, std::unique_ptr<folder_node> const &rhs)
+    {
+        return name_less(lhs->name_, rhs->name_);
+    });
+    std::sort(std::begin(node.files_), std::end(node.files_),
+              [](scanned_file const &lhs, scanned_file const &rhs)
+    {
+        return name_less(lhs.name_, rhs.name_);
+    });
+}
+
+void flatten(folder_node &node, std::vector<scanned_file> &files)
+{
+    for(auto &child : node.children_){
+        flatten(*child, files);
+    }
+    std::move(std::begin(node.files_), std::end(node.files_), std::back_inserter(files));
+}
+
+}
+
+folder_scanner::folder_scanner(QStringList const &exclude_content) :
+    thread_count_(1)
+{
+    //the plain names are looked up in the set, the wildcards are merged
+    //into one expression so every name is matched once
+    QStringList globs;
+    for(auto const &pattern : exclude_content){
+        if(pattern.contains('*') || pattern.contains('?') || pattern.contains('[')){
+            globs.push_back("(?:" + QRegularExpression::wildcardToRegularExpression(pattern) + ")");
+        }else{
+            names_.insert(pattern);
+        }
+    }
+    if(!globs.isEmpty()){
+        globs_.setPattern(globs.join('|'));
+        globs_.optimize();
+    }
+}
+
+bool folder_scanner::is_excluded(QString const &name) const
+{
+    return names_.find(name) != std::end(names_) ||
+            (!globs_.pattern().isEmpty() && globs_.match(name).hasMatch());
+}
+
+void folder_scanner::scan(QString const &folder, std::vector<scanned_file> &files) const
+{
+    folder_node root;
+    root.path_ = QDir(folder).absolutePath();
+    if(!QDir(root.path_).exists()){
+        return;
+    }
+
+    //every folder is listed by a task, the tree keep the order of the
+    //folders so the result do not depend on the order the tasks finish
+    int const thread_count = thread_count_ > 0 ? thread_count_ :
+                                                 std::max(1, QThread::idealThreadCount());
+    QThreadPool pool;
+    pool.setMaxThreadCount(thread_count);
+    std::function<void(folder_node*)> visit = [&](folder_node *node)
+    {
+        list_folder(*this, *node);
+        for(auto &child : node->children_){
+            folder_node *child_node = child.get();
+            if(thread_count == 1){
+                visit(child_node);
+            }else{
+                pool.start([child_node, &visit]()
+                {
+                    visit(child_node);
+                });
+            }
+        }
+    };
+    visit(&root);
+    pool.waitForDone();
+
+    flatten(root, files);
+}
+
+void folder_scanner::set_thread_count(int value)
+{
+    thread_count_ = value;
+}
+
+}
+
+}
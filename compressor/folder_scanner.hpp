@@ -0,0 +1,67 @@
+#ifndef QTE_CP_FOLDER_SCANNER_HPP
+#define QTE_CP_FOLDER_SCANNER_HPP
+
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+
+#include <set>
+#include <vector>
+
+namespace qte{
+
+namespace cp{
+
+/**
+ * A file found by folder_scanner
+ */
+struct scanned_file
+{
+    qint64 mtime_ = 0; //last modified time in msecs since epoch
+    QString name_; //path relative to the scanned folder, begin with "/"
+    QString path_; //absolute path
+    qint64 size_ = 0;
+};
+
+/**
+ * Walk through the folders concurrently and list the files. The order
+ * of the files is deterministic, the files of the sub folders come first
+ * (depth first, sorted by name), followed by the files of the folder
+ * (sorted by name), no matter how many threads are used
+ */
+class folder_scanner
+{
+public:
+    /**
+     * @param exclude_content names or wildcard patterns(*, ? and [])
+     * of the files and folders want to skip, they are compiled once
+     * and applied at every depth
+     */
+    explicit folder_scanner(QStringList const &exclude_content = {});
+
+    bool is_excluded(QString const &name) const;
+
+    /**
+     * @param folder the folder want to scan
+     * @param files the files inside the folder and its sub folders
+     */
+    void scan(QString const &folder, std::vector<scanned_file> &files) const;
+
+    /**
+     * Number of threads used to scan the folders, value <= 0 means
+     * QThread::idealThreadCount(). Default value is 1
+     * @param value number of threads
+     */
+    void set_thread_count(int value);
+
+private:
+    QRegularExpression globs_;
+    std::set<QString> names_;
+    int thread_count_;
+};
+
+}
+
+}
+
+#endif // QTE_CP_FOLDER_SCANNER_HPP
@@ -0,0 +1,40 @@
+#include "stream_format.hpp"
+#include "compressibility.hpp"
+
+namespace qte{
+
+namespace cp{
+
+int stream_header_size(quint16 version)
+{
+    return version >= 3 ? 11 : 10;
+}
+
+int block_header_size(quint16 version)
+{
+    return version >= 2 ? 9 : 8;
+}
+
+quint32 max_packed_block_size(quint32 block_size)
+{
+    //zlib may expand the incompressible data a little bit
+    return block_size + block_size / 1000 + 64;
+}
+
+bool pack_block(codec const &block_codec, QByteArray const &raw, int level,
+                QByteArray &packed)
+{
+    if(is_compressible(raw.constData(), raw.size())){
+        packed = block_codec.compress(raw.constData(), raw.size(), level);
+        if(!packed.isEmpty() && packed.size() < raw.size()){
+            return false;
+        }
+    }
+    packed = raw;
+
+    return true;
+}
+
+}
+
+}
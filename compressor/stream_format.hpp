@@ -0,0 +1,55 @@
+#ifndef QTE_CP_STREAM_FORMAT_HPP
+#define QTE_CP_STREAM_FORMAT_HPP
+
+#include "codec.hpp"
+
+#include <QByteArray>
+
+namespace qte{
+
+namespace cp{
+
+//Layout of the stream written by compress and compress_device
+//header : "QTEC" | version | block size | codec id
+//block : flags | raw size | packed size | packed data
+//the stream end with a block which raw size is 0
+
+//"QTEC", the first 4 bytes of the streaming format. Files without
+//this magic are treated as the single blob format of qCompress
+quint32 const stream_magic = 0x51544543;
+//version 2 added the flags of block, version 3 added the codec id
+quint16 const stream_version = 3;
+int const max_stream_block_size = 64 * 1024 * 1024;
+//the block is stored without compression
+quint8 const block_stored = 0x01;
+
+/**
+ * @return size of the stream header of the version
+ */
+int stream_header_size(quint16 version);
+
+/**
+ * @return size of the block header of the version
+ */
+int block_header_size(quint16 version);
+
+/**
+ * Worst case size of the packed block, used to reject corrupted data
+ */
+quint32 max_packed_block_size(quint32 block_size);
+
+/**
+ * Compress the block by the codec, do not waste cpu on the data which
+ * cannot shrink, store it as is if the sample or the compression tell
+ * it is incompressible
+ * @param packed the compressed data, or the raw data if it is stored
+ * @return true if the block is stored without compression
+ */
+bool pack_block(codec const &block_codec, QByteArray const &raw, int level,
+                QByteArray &packed);
+
+}
+
+}
+
+#endif // QTE_CP_STREAM_FORMAT_HPP
@@ -8,19 +8,73 @@
 #include <QNetworkProxy>
 #include <QRegularExpression>
 
+#include <algorithm>
 #include <functional>
 
 namespace qte{
 
 namespace net{
 
+namespace{
+
+//First byte of "Content-Range: bytes first-last/total", -1 if unknown
+qint64 content_range_first(QNetworkReply const &reply)
+{
+    static QRegularExpression const pattern("^bytes\\s+(\\d+)-");
+    auto const match = pattern.match(QString::fromLatin1(reply.rawHeader("Content-Range")));
+
+    return match.hasMatch() ? match.captured(1).toLongLong() : -1;
+}
+
+//Strong ETag or Last-Modified of the resource, weak ETag cannot be
+//used by If-Range
+QByteArray resource_validator(QNetworkReply const &reply)
+{
+    QByteArray const etag = reply.rawHeader("ETag");
+    return !etag.isEmpty() && !etag.startsWith("W/") ? etag : reply.rawHeader("Last-Modified");
+}
+
+//The host itself or the nearest parent domain which is a key of
+//domains, empty if none of them is
+template<typename Map>
+QString nearest_domain(QString const &host, Map const &domains)
+{
+    for(QString domain = host; !domain.isEmpty();){
+        if(domains.find(domain) != std::end(domains)){
+            return domain;
+        }
+        int const dot = domain.indexOf('.');
+        if(dot < 0){
+            break;
+        }
+        domain = domain.mid(dot + 1);
+    }
+
+    return {};
+}
+
+qint64 const min_segment_size = 1024 * 1024;
+//Qt stop reading the socket if the read buffer of the reply is full,
+//so the throttled reply slow down the server as well
+qint64 const read_buffer_size = 256 * 1024;
+//the throttled replies do not wake up more often than this
+qint64 const min_throttle_msec = 10;
+
+}
+
 download_supervisor::download_supervisor(QObject *parent)
     : QObject(parent),
+      idle_(true),
       max_download_file_(1),
+      max_download_per_host_(0),
+      max_resume_attempts_(0),
+      max_segments_(1),
       network_access_(new QNetworkAccessManager(this)),
       total_download_file_(0),
       unique_id_(0)
 {     
+    throttle_timer_.setSingleShot(true);
+    connect(&throttle_timer_, &QTimer::timeout, this, &download_supervisor::handle_throttle_timeout);
 }
 
 size_t download_supervisor::append(const QNetworkRequest &request, const QString &save_at)
@@ -44,64 +98,337 @@ size_t download_supervisor::append(const QNetworkRequest &request, int timeout_m
     return append(request, "", timeout_msec, false);
 }
 
+double download_supervisor::get_effective_rate() const
+{
+    return bandwidth_.get_effective_rate();
+}
+
 QNetworkAccessManager* download_supervisor::get_network_manager() const
 {
     return network_access_;
 }
 
+int download_supervisor::get_max_resume_attempts() const
+{
+    return max_resume_attempts_;
+}
+
 size_t download_supervisor::get_max_download_file() const
 {
     return max_download_file_;
 }
 
+size_t download_supervisor::get_max_download_per_host() const
+{
+    return max_download_per_host_;
+}
+
+int download_supervisor::get_max_segments() const
+{
+    return max_segments_;
+}
+
 void download_supervisor::set_max_download_file(size_t val)
 {
     max_download_file_ = val;
 }
 
+void download_supervisor::set_max_download_per_host(size_t val)
+{
+    max_download_per_host_ = val;
+    update_host_rings();
+}
+
+void download_supervisor::set_bandwidth(qint64 rate, qint64 burst)
+{
+    bandwidth_.set_rate(rate, burst);
+    apply_bandwidth();
+}
+
+void download_supervisor::set_host_bandwidth(QString const &domain, qint64 rate, qint64 burst)
+{
+    host_bandwidth_[domain.toLower()].set_rate(rate, burst);
+    apply_bandwidth();
+}
+
+void download_supervisor::set_task_bandwidth(size_t unique_id, qint64 rate, qint64 burst)
+{
+    auto it = id_table_.find(unique_id);
+    if(it != std::end(id_table_)){
+        it->second->bandwidth_.set_rate(rate, burst);
+        apply_bandwidth();
+    }
+}
+
+void download_supervisor::set_domain_limit(QString const &domain, size_t val)
+{
+    domain_limits_[domain.toLower()] = val;
+    update_host_rings();
+}
+
+void download_supervisor::set_max_resume_attempts(int val)
+{
+    max_resume_attempts_ = val;
+}
+
+void download_supervisor::set_max_segments(int val)
+{
+    max_segments_ = val;
+}
+
+void download_supervisor::set_priority(size_t unique_id, int priority)
+{
+    auto it = id_table_.find(unique_id);
+    if(it != std::end(id_table_)){
+        auto task = it->second;
+        bool const queued = task->state_ == task_state::queued;
+        if(queued){
+            dequeue(*task);
+        }
+        task->priority_ = priority;
+        if(queued){
+            enqueue(task);
+        }
+    }
+}
+
 void download_supervisor::set_proxy(const QNetworkProxy &proxy)
 {
     network_access_->setProxy(proxy);
 }
 
+size_t download_supervisor::resume(std::shared_ptr<download_task> task)
+{
+    //the queued or running task is in the list already, queue it again
+    //would corrupt the ready queue. The done task has nothing left, the
+    //range after its end would be rejected by the server
+    if(task->state_ != task_state::failed){
+        return task->unique_id_;
+    }
+
+    //the task saved in memory download from zero again
+    if(!task->save_as_file_){
+        task->data_.clear();
+    }
+    task->error_string_.clear();
+    task->file_can_open_ = true;
+    task->is_timeout_ = false;
+    task->network_error_code_ = QNetworkReply::NoError;
+    task->resume_attempts_ = 0;
+    id_table_.insert({task->unique_id_, task});
+    enqueue(task);
+
+    return task->unique_id_;
+}
+
 void download_supervisor::start_download_task(size_t unique_id)
 {
     auto it = id_table_.find(unique_id);
-    if(it != std::end(id_table_)){
-        download_start(it->second);
+    if(it != std::end(id_table_) && it->second->state_ == task_state::queued &&
+            total_download_file_ < max_download_file_ && !host_full(it->second->host_)){
+        start_queued(it->second);
     }
+    start_next_download();
 }
 
 void download_supervisor::start_next_download()
 {
-    //TODO : use hint to speed things up
-    if(!id_table_.empty()){
-        auto it = std::begin(id_table_);
-        for(; it != std::end(id_table_); ++it){
-            if(it->second->network_error_code_ == QNetworkReply::NoError &&
-                    it->second->file_can_open_){
-                download_start(it->second);
-                break;
+    //the queue only hold the tasks waiting for a slot and the rings only
+    //hold the hosts below their limit, so every free slot is filled
+    //without scanning the tasks
+    while(total_download_file_ < max_download_file_){
+        auto it = std::find_if(std::begin(ready_queue_), std::end(ready_queue_),
+                               [](std::pair<int const, priority_level> const &value)
+        {
+            return !value.second.ring_.empty();
+        });
+        if(it == std::end(ready_queue_)){
+            break;
+        }
+        //the host served now move to the back of the ring
+        auto &ring = it->second.ring_;
+        ring.splice(std::end(ring), ring, std::begin(ring));
+        start_queued(it->second.hosts_[ring.back()].tasks_.front());
+    }
+    //only emitted when the last running task finish
+    if(!idle_ && ready_queue_.empty() && total_download_file_ == 0){
+        idle_ = true;
+        emit all_download_finished();
+    }
+}
+
+void download_supervisor::start_queued(std::shared_ptr<download_task> task)
+{
+    dequeue(*task);
+    acquire_host(task->host_);
+    download_start(task);
+}
+
+void download_supervisor::dequeue(download_task &task)
+{
+    auto it = ready_queue_.find(task.priority_);
+    if(it == std::end(ready_queue_)){
+        return;
+    }
+    auto hit = it->second.hosts_.find(task.host_);
+    if(hit == std::end(it->second.hosts_)){
+        return;
+    }
+    hit->second.tasks_.erase(task.queue_pos_);
+    if(hit->second.tasks_.empty()){
+        if(hit->second.in_ring_){
+            it->second.ring_.erase(hit->second.ring_pos_);
+        }
+        it->second.hosts_.erase(hit);
+        if(it->second.hosts_.empty()){
+            ready_queue_.erase(it);
+        }
+    }
+}
+
+void download_supervisor::enqueue(std::shared_ptr<download_task> task)
+{
+    auto &level = ready_queue_[task->priority_];
+    auto &queue = level.hosts_[task->host_];
+    if(!queue.in_ring_ && !host_full(task->host_)){
+        queue.in_ring_ = true;
+        queue.ring_pos_ = level.ring_.insert(std::end(level.ring_), task->host_);
+    }
+    task->state_ = task_state::queued;
+    task->queue_pos_ = queue.tasks_.insert(std::end(queue.tasks_), task);
+}
+
+void download_supervisor::acquire_host(QString const &host)
+{
+    ++host_running_[host];
+    if(host_full(host)){
+        //the queued tasks of the host wait until one of its task finish
+        for(auto &level : ready_queue_){
+            auto it = level.second.hosts_.find(host);
+            if(it != std::end(level.second.hosts_) && it->second.in_ring_){
+                level.second.ring_.erase(it->second.ring_pos_);
+                it->second.in_ring_ = false;
             }
         }
-        if(it == std::end(id_table_)){
-            emit all_download_finished();
+    }
+}
+
+void download_supervisor::release_host(QString const &host)
+{
+    auto it = host_running_.find(host);
+    if(it == std::end(host_running_)){
+        return;
+    }
+    if(--it->second == 0){
+        host_running_.erase(it);
+    }
+    if(!host_full(host)){
+        for(auto &level : ready_queue_){
+            auto hit = level.second.hosts_.find(host);
+            if(hit != std::end(level.second.hosts_) && !hit->second.in_ring_){
+                hit->second.in_ring_ = true;
+                hit->second.ring_pos_ = level.second.ring_.insert(std::end(level.second.ring_), host);
+            }
         }
-    }else{
-        emit all_download_finished();
     }
 }
 
-void download_supervisor::handle_download_finished()
+void download_supervisor::update_host_rings()
 {
-    if(total_download_file_ > 0){
-        --total_download_file_;
+    //the queued task may belong to another domain after the domain limits
+    //changed, move it to the queue of the new domain. The running task
+    //keep the domain it is counted in until it finish
+    std::vector<std::shared_ptr<download_task>> moved;
+    for(auto const &level : ready_queue_){
+        for(auto const &host : level.second.hosts_){
+            for(auto const &task : host.second.tasks_){
+                if(host_key(task->get_url()) != host.first){
+                    moved.emplace_back(task);
+                }
+            }
+        }
+    }
+    for(auto &task : moved){
+        dequeue(*task);
+        task->host_ = host_key(task->get_url());
+        enqueue(task);
+    }
+
+    //the limits changed, the hosts below the new limit join the rings
+    //and the hosts reach it leave
+    for(auto &level : ready_queue_){
+        for(auto &host : level.second.hosts_){
+            bool const full = host_full(host.first);
+            if(full && host.second.in_ring_){
+                level.second.ring_.erase(host.second.ring_pos_);
+                host.second.in_ring_ = false;
+            }else if(!full && !host.second.in_ring_){
+                host.second.in_ring_ = true;
+                host.second.ring_pos_ = level.second.ring_.insert(std::end(level.second.ring_),
+                                                                  host.first);
+            }
+        }
     }
+    //fill the slots of the hosts got higher limit, the tasks are not
+    //started if the download is not started yet
+    if(!idle_){
+        start_next_download();
+    }
+}
+
+bool download_supervisor::host_full(QString const &host) const
+{
+    auto const lit = domain_limits_.find(host);
+    size_t const limit = lit != std::end(domain_limits_) ? lit->second : max_download_per_host_;
+    if(limit == 0){
+        return false;
+    }
+    auto const rit = host_running_.find(host);
+
+    return rit != std::end(host_running_) && rit->second >= limit;
+}
+
+QString download_supervisor::host_key(QUrl const &url) const
+{
+    //the host belong to the nearest domain with limit
+    QString const host = url.host().toLower();
+    QString const domain = nearest_domain(host, domain_limits_);
+
+    return domain.isEmpty() ? host : domain;
+}
+
+void download_supervisor::finish_task(std::shared_ptr<download_task> task)
+{
+    task->state_ = task->network_error_code_ == QNetworkReply::NoError && task->file_can_open_ ?
+                task_state::done : task_state::failed;
+    release_host(task->host_);
+    auto id_it = id_table_.find(task->unique_id_);
+    if(id_it != std::end(id_table_)){
+        id_table_.erase(id_it);
+    }
+    emit download_finished(task);
+    start_next_download();
+}
+
+void download_supervisor::handle_download_finished()
+{
     auto *reply = qobject_cast<QNetworkReply*>(sender());
     if(reply){
         auto rit = reply_table_.find(reply);
         if(rit != std::end(reply_table_)){
+            //the data held back by throttling belong to the task
+            read_reply(reply, true);
+            throttled_.erase(std::remove(std::begin(throttled_), std::end(throttled_), reply),
+                             std::end(throttled_));
             auto task = rit->second;            
+            if(!task->segments_.empty()){
+                reply_table_.erase(rit);
+                handle_segment_finished(task, reply);
+                return;
+            }
+            if(total_download_file_ > 0){
+                --total_download_file_;
+            }
             task->timer_.stop();
             task->file_.close();
             if(reply->error() != QNetworkReply::NoError){
@@ -110,14 +437,23 @@ void download_supervisor::handle_download_finished()
                     task->error_string_ = reply->errorString();
                 }
             }
-            auto const unique_id = task->unique_id_;            
             reply_table_.erase(rit);
-            auto id_it = id_table_.find(unique_id);            
-            if(id_it != std::end(id_table_)){
-                id_table_.erase(id_it);
-            }            
-            emit download_finished(task);
-            start_next_download();
+            if(task->range_rejected_){
+                task->error_string_ = tr("The server cannot resume the download");
+            }
+            if(should_resume(*task)){
+                //continue from the end of the partial file
+                ++task->resume_attempts_;
+                task->error_string_.clear();
+                task->is_timeout_ = false;
+                task->network_error_code_ = QNetworkReply::NoError;
+                download_start(task);
+                if(task->state_ == task_state::failed){//the slot is free again
+                    start_next_download();
+                }
+                return;
+            }
+            finish_task(task);
         }        
     }else{
         qDebug()<<__func__<<":QNetworkReply is nullptr";
@@ -130,7 +466,10 @@ void download_supervisor::handle_error(QNetworkReply::NetworkError)
     if(reply){
         auto it = reply_table_.find(reply);
         if(it != std::end(reply_table_)){
-            it->second->error_string_ = reply->errorString();
+            //keep the first error, the aborted replies follow it
+            if(it->second->error_string_.isEmpty()){
+                it->second->error_string_ = reply->errorString();
+            }
             emit error(it->second, reply->errorString());
         }
     }
@@ -138,15 +477,88 @@ void download_supervisor::handle_error(QNetworkReply::NetworkError)
 
 void download_supervisor::handle_download_progress(qint64 bytesReceived, qint64 bytesTotal)
 {
-    qDebug()<<__func__<< " receive "<<bytesReceived;
-    qDebug()<<__func__<< " total "<<bytesTotal;
     auto *reply = qobject_cast<QNetworkReply*>(sender());
     if(reply){        
         auto rit = reply_table_.find(reply);
         if(rit != std::end(reply_table_)){
             restart_timer(*rit->second);
-            emit download_progress(rit->second, bytesReceived,
-                                   bytesTotal);
+            auto const &segments = rit->second->segments_;
+            if(!segments.empty()){
+                //sum of the segments, the preallocated size is the total
+                qint64 remain = 0;
+                for(auto const &seg : segments){
+                    remain += seg.end_ - seg.pos_;
+                }
+                emit download_progress(rit->second, rit->second->total_size_ - remain,
+                                       rit->second->total_size_);
+                return;
+            }
+            //the progress of the resumed task count the partial file
+            qint64 const offset = rit->second->resume_offset_;
+            emit download_progress(rit->second, bytesReceived + offset,
+                                   bytesTotal > 0 ? bytesTotal + offset : bytesTotal);
+        }
+    }
+}
+
+void download_supervisor::handle_meta_data_changed()
+{
+    auto *reply = qobject_cast<QNetworkReply*>(sender());
+    if(!reply){
+        return;
+    }
+    auto it = reply_table_.find(reply);
+    if(it == std::end(reply_table_)){
+        return;
+    }
+
+    auto &task = *it->second;
+    int const status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if(!task.segments_.empty()){
+        //every segment must get the range it asked for, or the file would
+        //mix different versions of the resource. Abort all of them and
+        //download by one connection if any segment fail
+        auto seg = std::find_if(std::begin(task.segments_), std::end(task.segments_),
+                                [reply](download_task::segment const &value)
+        {
+            return value.reply_ == reply;
+        });
+        if(seg != std::end(task.segments_) &&
+                (status != 206 || content_range_first(*reply) != seg->pos_)){
+            task.range_rejected_ = true;
+            std::vector<QNetworkReply*> replies;
+            for(auto const &value : task.segments_){
+                if(value.reply_){
+                    replies.push_back(value.reply_);
+                }
+            }
+            for(auto *value : replies){
+                value->abort();
+            }
+        }
+        return;
+    }
+
+    bool const partial = status == 206 && content_range_first(*reply) == task.resume_offset_;
+    if(status == 200 || partial){
+        QByteArray const validator = resource_validator(*reply);
+        if(!validator.isEmpty() || !partial){
+            task.validator_ = validator;
+        }
+    }
+    //only the server ignore the range(200) or send the wrong range
+    //invalidate the partial data. The other status(4xx, 5xx) fail the
+    //reply, the partial file is kept so the resume policy can retry
+    //from the same offset
+    bool const wrong_range = status == 206 && !partial;
+    if(task.resume_offset_ > 0 && (status == 200 || wrong_range) && task.file_.isOpen()){
+        task.file_.resize(0);
+        task.file_.seek(0);
+        task.resume_offset_ = 0;
+        if(wrong_range){//aborted and downloaded from zero if there are attempts left
+            task.range_rejected_ = true;
+            task.validator_.clear();
+            reply->abort();
         }
     }
 }
@@ -155,18 +567,131 @@ void download_supervisor::handle_ready_read()
 {
     auto *reply = qobject_cast<QNetworkReply*>(sender());
     if(reply){
-        auto it = reply_table_.find(reply);
-        if(it != std::end(reply_table_)){
-            QByteArray data(reply->bytesAvailable(), Qt::Uninitialized);
-            if(it->second->save_as_file_ && it->second->file_.isOpen()){
-                reply->read(data.data(), data.size());
-                it->second->file_.write(data);
-            }else{
-                it->second->data_ += data;
+        read_reply(reply, false);
+    }else{
+        qDebug()<<__func__<< ":reply is nullptr or fail to cast from sender()";
+    }
+}
+
+void download_supervisor::handle_throttle_timeout()
+{
+    //the first reply take the tokens first, start from a different one
+    //every time so the replies share the global and host buckets in turn
+    std::vector<QNetworkReply*> replies;
+    replies.swap(throttled_);
+    if(replies.size() > 1){
+        std::rotate(std::begin(replies), std::begin(replies) + 1, std::end(replies));
+    }
+    for(auto *reply : replies){
+        read_reply(reply, false);
+    }
+}
+
+void download_supervisor::apply_bandwidth()
+{
+    //the new rate take effect at once instead of the next refill
+    if(!throttled_.empty()){
+        throttle_timer_.start(0);
+    }
+}
+
+void download_supervisor::read_reply(QNetworkReply *reply, bool drain)
+{
+    auto it = reply_table_.find(reply);
+    if(it == std::end(reply_table_)){
+        return;
+    }
+
+    //the data exceed the tokens stay in the read buffer of the reply
+    //until the buckets are refilled, the finished reply is drained and
+    //the debt is paid back by the following reads
+    auto &task = *it->second;
+    qint64 size = reply->bytesAvailable();
+    bool throttled = false;
+    if(!drain){
+        qint64 allowed = std::min(bandwidth_.available(), task.bandwidth_.available());
+        if(task.host_bandwidth_){
+            allowed = std::min(allowed, task.host_bandwidth_->available());
+        }
+        throttled = allowed < size;
+        size = std::min(size, allowed);
+    }
+    QByteArray const data = size > 0 ? reply->read(size) : QByteArray();
+    bandwidth_.consume(data.size());
+    task.bandwidth_.consume(data.size());
+    if(task.host_bandwidth_){
+        task.host_bandwidth_->consume(data.size());
+    }
+    if(throttled){
+        throttle(task, reply);
+    }
+    if(data.isEmpty()){
+        return;
+    }
+
+    for(auto &seg : task.segments_){
+        if(seg.reply_ == reply){
+            //write at the offset of the segment, drop the bytes
+            //beyond the range
+            qint64 const write_size = std::min<qint64>(data.size(), seg.end_ - seg.pos_);
+            if(!task.file_.seek(seg.pos_) ||
+                    task.file_.write(data.constData(), write_size) != write_size){
+                handle_write_error(it->second, reply);
+                return;
             }
+            seg.pos_ += write_size;
+            return;
+        }
+    }
+    if(task.save_as_file_){
+        //the body of the failed resume request(4xx, 5xx) is not part
+        //of the resource, drop it to keep the partial file intact
+        bool const resumed = task.resume_offset_ > 0 &&
+                reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 206;
+        if(task.file_.isOpen() && (task.resume_offset_ == 0 || resumed) &&
+                task.file_.write(data) != data.size()){
+            handle_write_error(it->second, reply);
         }
     }else{
-        qDebug()<<__func__<< ":reply is nullptr or fail to cast from sender()";
+        task.data_ += data;
+    }
+}
+
+void download_supervisor::handle_write_error(std::shared_ptr<download_task> task,
+                                             QNetworkReply *reply)
+{
+    //download again cannot help a full disk, stop the task and do not
+    //resume it automatically
+    task->file_can_open_ = false;
+    task->error_string_ = tr("Cannot write file %1 : %2").arg(task->file_.fileName(),
+                                                              task->file_.errorString());
+    emit error(task, task->error_string_);
+    std::vector<QNetworkReply*> replies(1, reply);
+    for(auto const &seg : task->segments_){
+        if(seg.reply_ && seg.reply_ != reply){
+            replies.push_back(seg.reply_);
+        }
+    }
+    for(auto *value : replies){
+        value->abort();
+    }
+}
+
+void download_supervisor::throttle(download_task &task, QNetworkReply *reply)
+{
+    if(std::find(std::begin(throttled_), std::end(throttled_), reply) == std::end(throttled_)){
+        throttled_.push_back(reply);
+    }
+
+    //wake up when the most restrictive bucket can afford a read
+    qint64 const bytes = std::min(reply->bytesAvailable(), read_buffer_size);
+    qint64 wait = std::max(bandwidth_.msec_until(bytes), task.bandwidth_.msec_until(bytes));
+    if(task.host_bandwidth_){
+        wait = std::max(wait, task.host_bandwidth_->msec_until(bytes));
+    }
+    wait = std::max(wait, min_throttle_msec);
+    if(!throttle_timer_.isActive() || throttle_timer_.remainingTime() > wait){
+        throttle_timer_.start(static_cast<int>(wait));
     }
 }
 
@@ -176,33 +701,187 @@ size_t download_supervisor::append(const QNetworkRequest &request, const QString
     auto task = std::make_shared<download_task>();
     task->unique_id_ = unique_id_++;
     task->network_request_ = request;
+    task->host_ = host_key(request.url());
+    QString const domain = nearest_domain(request.url().host().toLower(), host_bandwidth_);
+    if(!domain.isEmpty()){
+        task->host_bandwidth_ = &host_bandwidth_[domain];
+    }
     task->save_at_ = save_at;
     task->save_as_file_ = save_as_file;
     task->timeout_msec_ = timeout_msec;
     id_table_.insert({task->unique_id_, task});
+    enqueue(task);
 
     return task->unique_id_;
 }
 
+void download_supervisor::connect_reply(std::shared_ptr<download_task> task, QNetworkReply *reply)
+{
+    reply_table_.insert({reply, task});
+    reply->setReadBufferSize(read_buffer_size);
+    connect(&task->timer_, &QTimer::timeout, reply, [task, reply]()
+    {
+        task->timer_.stop();
+        task->is_timeout_ = true;
+        reply->abort();
+    });
+    connect(reply, &QNetworkReply::errorOccurred, this, &download_supervisor::handle_error);
+    connect(reply, &QNetworkReply::metaDataChanged, this, &download_supervisor::handle_meta_data_changed);
+    connect(reply, &QNetworkReply::readyRead, this, &download_supervisor::handle_ready_read);
+    connect(reply, static_cast<void(QNetworkReply::*)()>(&QNetworkReply::finished),
+            this, &download_supervisor::handle_download_finished);
+    connect(reply, &QNetworkReply::downloadProgress, this, &download_supervisor::handle_download_progress);
+    connect(reply, static_cast<void(QNetworkReply::*)()>(&QNetworkReply::finished),
+            reply, &QNetworkReply::deleteLater);
+}
+
+void download_supervisor::handle_probe_finished()
+{
+    auto *reply = qobject_cast<QNetworkReply*>(sender());
+    auto rit = reply_table_.find(reply);
+    if(!reply || rit == std::end(reply_table_)){
+        return;
+    }
+    auto task = rit->second;
+    reply_table_.erase(rit);
+    if(total_download_file_ > 0){
+        --total_download_file_;
+    }
+    task->timer_.stop();
+
+    //the segments need the size of the resource, support of ranges and
+    //a validator to make sure every segment get the same version
+    qint64 const size = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+    int const status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QByteArray const validator = resource_validator(*reply);
+    qint64 const count = std::min<qint64>(max_segments_, size / min_segment_size);
+    if(reply->error() != QNetworkReply::NoError || status != 200 || count < 2 ||
+            reply->rawHeader("Accept-Ranges").trimmed().toLower() != "bytes" ||
+            validator.isEmpty() || !task->file_.resize(size)){
+        launch_download_task(task);
+        return;
+    }
+
+    task->total_size_ = size;
+    task->validator_ = validator;
+    task->segments_.resize(static_cast<size_t>(count));
+    for(qint64 i = 0; i != count; ++i){
+        auto &seg = task->segments_[static_cast<size_t>(i)];
+        seg.pos_ = size / count * i;
+        seg.end_ = i + 1 == count ? size : size / count * (i + 1);
+    }
+    launch_segments(task);
+}
+
+void download_supervisor::handle_segment_finished(std::shared_ptr<download_task> task,
+                                                  QNetworkReply *reply)
+{
+    bool active = false;
+    for(auto &seg : task->segments_){
+        if(seg.reply_ == reply){
+            seg.reply_ = nullptr;
+        }
+        active = active || seg.reply_;
+    }
+    if(reply->error() != QNetworkReply::NoError &&
+            task->network_error_code_ == QNetworkReply::NoError){
+        task->network_error_code_ = reply->error();
+        if(task->error_string_.isEmpty()){
+            task->error_string_ = reply->errorString();
+        }
+    }
+    if(active){//the task finish with its last segment
+        return;
+    }
+
+    if(total_download_file_ > 0){
+        --total_download_file_;
+    }
+    task->timer_.stop();
+    if(task->range_rejected_){
+        //download the whole file by one connection
+        task->error_string_.clear();
+        task->is_timeout_ = false;
+        task->network_error_code_ = QNetworkReply::NoError;
+        task->resume_offset_ = 0;
+        task->segments_.clear();
+        task->file_.resize(0);
+        task->file_.seek(0);
+        launch_download_task(task);
+        return;
+    }
+
+    bool const complete = std::all_of(std::begin(task->segments_), std::end(task->segments_),
+                                      [](download_task::segment const &seg)
+    {
+        return seg.pos_ == seg.end_;
+    });
+    if(!complete && task->network_error_code_ == QNetworkReply::NoError){
+        //the connection is closed before the range is received
+        task->network_error_code_ = QNetworkReply::RemoteHostClosedError;
+        task->error_string_ = tr("The connection is closed before the download complete");
+    }
+    if(!complete && should_resume(*task)){
+        //only the unfinished segments continue
+        ++task->resume_attempts_;
+        task->error_string_.clear();
+        task->is_timeout_ = false;
+        task->network_error_code_ = QNetworkReply::NoError;
+        launch_segments(task);
+        return;
+    }
+    task->file_.close();
+    finish_task(task);
+}
+
 void download_supervisor::launch_download_task(std::shared_ptr<download_supervisor::download_task> task)
 {
     ++total_download_file_;
-    task->network_reply_ = network_access_->get(task->network_request_);    
+    QNetworkRequest request = task->network_request_;
+    if(task->resume_offset_ > 0){
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(task->resume_offset_) + "-");
+        request.setRawHeader("If-Range", task->validator_);
+    }
+    task->range_rejected_ = false;
+    task->network_reply_ = network_access_->get(request);    
+    restart_timer(*task);
+    connect_reply(task, task->network_reply_);
+}
+
+void download_supervisor::launch_probe(std::shared_ptr<download_task> task)
+{
+    ++total_download_file_;
+    task->network_reply_ = network_access_->head(task->network_request_);
     restart_timer(*task);
     reply_table_.insert({task->network_reply_, task});
-    connect(&task->timer_, &QTimer::timeout, task->network_reply_, [task]()
+    QNetworkReply *reply = task->network_reply_;
+    connect(&task->timer_, &QTimer::timeout, reply, [task, reply]()
     {
         task->timer_.stop();
-        task->is_timeout_ = true;
-        task->network_reply_->abort();
+        reply->abort();
     });
-    connect(task->network_reply_, &QNetworkReply::errorOccurred, this, &download_supervisor::handle_error);
-    connect(task->network_reply_, &QNetworkReply::readyRead, this, &download_supervisor::handle_ready_read);
-    connect(task->network_reply_, static_cast<void(QNetworkReply::*)()>(&QNetworkReply::finished),
-            this, &download_supervisor::handle_download_finished);
-    connect(task->network_reply_, &QNetworkReply::downloadProgress, this, &download_supervisor::handle_download_progress);
-    connect(task->network_reply_, static_cast<void(QNetworkReply::*)()>(&QNetworkReply::finished),
-            task->network_reply_, &QNetworkReply::deleteLater);
+    connect(reply, static_cast<void(QNetworkReply::*)()>(&QNetworkReply::finished),
+            this, &download_supervisor::handle_probe_finished);
+    connect(reply, static_cast<void(QNetworkReply::*)()>(&QNetworkReply::finished),
+            reply, &QNetworkReply::deleteLater);
+}
+
+void download_supervisor::launch_segments(std::shared_ptr<download_task> task)
+{
+    //the segments are counted as one download
+    ++total_download_file_;
+    task->range_rejected_ = false;
+    restart_timer(*task);
+    for(auto &seg : task->segments_){
+        if(seg.pos_ != seg.end_){
+            QNetworkRequest request = task->network_request_;
+            request.setRawHeader("Range", "bytes=" + QByteArray::number(seg.pos_) + "-" +
+                                 QByteArray::number(seg.end_ - 1));
+            request.setRawHeader("If-Range", task->validator_);
+            seg.reply_ = network_access_->get(request);
+            connect_reply(task, seg.reply_);
+        }
+    }
 }
 
 void download_supervisor::restart_timer(download_supervisor::download_task &task)
@@ -212,24 +891,71 @@ void download_supervisor::restart_timer(download_supervisor::download_task &task
     }
 }
 
+bool download_supervisor::open_file(download_task &task)
+{
+    if(task.file_.fileName().isEmpty()){
+        auto const unique_name = utils::unique_file_name(task.save_at_, QFileInfo(task.get_url().toString()).fileName());
+        task.file_.setFileName(task.save_at_ + "/" + unique_name);
+        task.resume_offset_ = 0;
+        return task.file_.open(QIODevice::WriteOnly);
+    }
+
+    //the file of the resumed task, without validator the server cannot
+    //tell whether the resource is changed, so download from zero
+    if(!task.file_.open(QIODevice::ReadWrite)){
+        return false;
+    }
+    if(!task.segments_.empty()){//preallocated, the segments know where to continue
+        return true;
+    }
+    task.resume_offset_ = task.validator_.isEmpty() ? 0 : task.file_.size();
+    if(task.resume_offset_ == 0){
+        return task.file_.resize(0);
+    }
+
+    return task.file_.seek(task.resume_offset_);
+}
+
+bool download_supervisor::should_resume(download_task const &task) const
+{
+    if(!task.save_as_file_ || !task.file_can_open_ ||
+            task.resume_attempts_ >= max_resume_attempts_){
+        return false;
+    }
+
+    //timeout, network layer error(1~99) and server error(401~499) are
+    //transient, the other errors would happen again
+    auto const code = task.network_error_code_;
+    return task.range_rejected_ || task.is_timeout_ ||
+            (code > QNetworkReply::NoError && code < 100 &&
+             code != QNetworkReply::OperationCanceledError) ||
+            (code >= 401 && code < 500);
+}
+
 void download_supervisor::download_start(std::shared_ptr<download_task> task)
 {
-    if(total_download_file_ < max_download_file_){
-        if(task->save_as_file_){
-            auto const unique_name = utils::unique_file_name(task->save_at_, QFileInfo(task->get_url().toString()).fileName());
-            qDebug()<<__func__<<":"<<task->save_at_ + "/" + unique_name;
-            task->file_.setFileName(task->save_at_ + "/" + unique_name);
-            if(task->file_.open(QIODevice::WriteOnly)){
+    idle_ = false;
+    task->state_ = task_state::running;
+    if(task->save_as_file_){
+        if(open_file(*task)){
+            if(!task->segments_.empty()){
+                launch_segments(task);
+            }else if(max_segments_ > 1 && task->resume_offset_ == 0){
+                launch_probe(task);
+            }else{
                 launch_download_task(task);
-            }else{                
-                task->file_can_open_ = false;
-                task->error_string_ = tr("Cannot open file %1").arg(task->file_.fileName());
-                emit error(task, task->error_string_);
-                emit download_finished(task);
             }
-        }else{
-            launch_download_task(task);
+        }else{                
+            task->file_can_open_ = false;
+            task->state_ = task_state::failed;
+            task->error_string_ = tr("Cannot open file %1").arg(task->file_.fileName());
+            release_host(task->host_);
+            id_table_.erase(task->unique_id_);
+            emit error(task, task->error_string_);
+            emit download_finished(task);
         }
+    }else{
+        launch_download_task(task);
     }
 }
 
@@ -253,11 +979,26 @@ QString download_supervisor::download_task::get_save_as() const
     return file_.fileName();
 }
 
+double download_supervisor::download_task::get_effective_rate() const
+{
+    return bandwidth_.get_effective_rate();
+}
+
 bool download_supervisor::download_task::get_is_timeout() const
 {
     return is_timeout_;
 }
 
+int download_supervisor::download_task::get_priority() const
+{
+    return priority_;
+}
+
+download_supervisor::task_state download_supervisor::download_task::get_state() const
+{
+    return state_;
+}
+
 size_t download_supervisor::download_task::get_unique_id() const
 {
     return unique_id_;
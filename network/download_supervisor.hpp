@@ -1,14 +1,20 @@
 #ifndef QTE_NET_DOWNLOAD_SUPERVISOR_HPP
 #define QTE_NET_DOWNLOAD_SUPERVISOR_HPP
 
+#include "token_bucket.hpp"
+
 #include <QFile>
 #include <QNetworkReply>
 #include <QObject>
 #include <QTimer>
 #include <QUrl>
 
+#include <functional>
+#include <list>
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 class QNetworkAccessManager;
 
@@ -24,32 +30,67 @@ class download_supervisor : public QObject
 {
     Q_OBJECT
 public:
+    enum class task_state
+    {
+        queued, //waiting for a free slot
+        running,
+        failed, //finished with error
+        done
+    };
+
     struct download_task
     {
         friend class download_supervisor;
 
+        /**
+         * @return bytes per second the task is receiving recently
+         */
+        double get_effective_rate() const;
         QString const& get_error_string() const;
         QNetworkReply::NetworkError get_network_error_code() const;
         QString const& get_save_at() const;
         QString get_save_as() const;
         bool get_is_timeout() const;
+        int get_priority() const;
+        task_state get_state() const;
         size_t get_unique_id() const;
         QUrl get_url() const;        
 
     private:
+        //byte range of the resource downloaded by one connection
+        struct segment
+        {
+            qint64 end_ = 0; //one past the last byte
+            qint64 pos_ = 0; //next byte to write
+            QNetworkReply *reply_ = nullptr;
+        };
+
+        token_bucket bandwidth_;
         QByteArray data_;
         QString error_string_;
         QFile file_;
-        bool file_can_open_ = true;
+        bool file_can_open_ = true; //false if the file cannot be opened or written
+        QString host_; //host or domain group sharing the connection limit
+        token_bucket *host_bandwidth_ = nullptr; //shared by the domain, nullptr if no limit
         bool is_timeout_ = false;
         QNetworkReply::NetworkError network_error_code_ = QNetworkReply::NoError;
         QNetworkReply *network_reply_ = nullptr;
         QNetworkRequest network_request_;
+        int priority_ = 0;
+        //position in the ready queue, valid if state_ is queued
+        std::list<std::shared_ptr<download_task>>::iterator queue_pos_;
+        bool range_rejected_ = false; //server cannot resume, restart from zero
+        int resume_attempts_ = 0;
+        qint64 resume_offset_ = 0; //first byte requested by current reply
         QString save_at_;
         bool save_as_file_ = true;
+        std::vector<segment> segments_; //empty if not segmented
+        task_state state_ = task_state::queued;
+        qint64 total_size_ = -1; //size of the resource if it is segmented
         QTimer timer_;
         int timeout_msec_ = -1;
         size_t unique_id_ = 0;
+        QByteArray validator_; //strong ETag or Last-Modified of the resource
     };
 
     explicit download_supervisor(QObject *parent = nullptr);
@@ -84,8 +125,19 @@ public:
      */
     size_t append(QNetworkRequest const &request, int timeout_msec);
 
+    /**
+     * @return bytes per second received by all of the tasks recently
+     */
+    double get_effective_rate() const;
+
     QNetworkAccessManager* get_network_manager() const;
 
+    /**
+     * How many times a file task is resumed automatically after timeout,
+     * network error or server error. Default value is 0
+     */
+    int get_max_resume_attempts() const;
+
     /**
       * This value determine how many items could be downloaded
       * at the same time
@@ -93,16 +145,113 @@ public:
       */
     size_t get_max_download_file() const;
 
+    /**
+     * Maximum tasks of one host downloading at the same time, 0 means
+     * no limit. Default value is 0
+     */
+    size_t get_max_download_per_host() const;
+
+    /**
+     * Maximum connections used to download one file. Default value is 1
+     */
+    int get_max_segments() const;
+
     /**
       * Set maximum download size
       * @param maximum download size
       */
     void set_max_download_file(size_t val);
 
+    /**
+     * Limit the bandwidth of all of the tasks. The data beyond the limit
+     * are left in the read buffer of the reply, when the buffer is full
+     * Qt stop reading the socket, so the server slow down too. The limits
+     * can be changed while downloading
+     * @param rate bytes per second, <= 0 means no limit
+     * @param burst bytes can be received at once after idle, <= 0
+     * means one second of rate
+     */
+    void set_bandwidth(qint64 rate, qint64 burst = 0);
+
+    /**
+     * Same as set_bandwidth, but limit the tasks of the domain and its
+     * subdomains. A new domain only affect the tasks appended later
+     * @param domain the host or domain
+     */
+    void set_host_bandwidth(QString const &domain, qint64 rate, qint64 burst = 0);
+
+    /**
+     * Same as set_bandwidth, but limit one task
+     * @param unique_id id of the task
+     */
+    void set_task_bandwidth(size_t unique_id, qint64 rate, qint64 burst = 0);
+
+    /**
+     * Set the limit of every host, the queued tasks of different hosts
+     * start in turn, so a host with few tasks do not wait behind the
+     * host with many tasks
+     * @param val maximum tasks of one host, 0 means no limit
+     */
+    void set_max_download_per_host(size_t val);
+
+    /**
+     * Set the limit of a domain, which override set_max_download_per_host.
+     * The domain and all of its subdomains share the limit, e.g. the tasks
+     * of "a.example.com" and "b.example.com" are counted together if the
+     * limit of "example.com" is set. The queued tasks are moved to the
+     * domain at once, the running tasks are counted in the domain they
+     * started in until they finish
+     * @param domain the host or domain
+     * @param val maximum tasks of the domain, 0 means no limit
+     */
+    void set_domain_limit(QString const &domain, size_t val);
+
+    /**
+     * Set how many times a file task is resumed automatically. The
+     * resumed task keep the partial file and request the rest of the
+     * data by "Range", "If-Range" make sure the resource is not changed.
+     * If the server do not support range or the resource is changed, the
+     * file is downloaded from zero again
+     * @param val maximum resume attempts of every task
+     */
+    void set_max_resume_attempts(int val);
+
+    /**
+     * Download one large file by several connections. If val > 1, the
+     * file task probe the resource by HEAD first, if the server accept
+     * ranges and the size is known, the file is preallocated and split
+     * into at most val ranges(no smaller than 1MB) downloaded in parallel,
+     * each range is written at its offset. download_progress report the
+     * sum of the ranges. Otherwise the file is downloaded by one connection
+     * @param val maximum connections of one file
+     */
+    void set_max_segments(int val);
+
+    /**
+     * Change the priority of a queued task, the task with higher priority
+     * start first, the tasks with the same priority start by the order
+     * they are queued. Default priority is 0
+     * @param unique_id id of the task
+     * @param priority priority of the task
+     */
+    void set_priority(size_t unique_id, int priority);
+
     void set_proxy(QNetworkProxy const &proxy);
 
     /**
-     * @brief start to download if unique id exist in task list
+     * Put the task finished with error back to the download list, the
+     * partial file is kept and the download continue from where it
+     * stopped, the task saved in memory download from the beginning.
+     * Call start_download_task to start it. Do nothing if the task is not
+     * failed
+     * @param task the task emitted by download_finished
+     * @return unique id of the task
+     */
+    size_t resume(std::shared_ptr<download_task> task);
+
+    /**
+     * @brief start to download if unique id exist in task list, then
+     * fill the rest of the free slots by the queued tasks
      * @param unique_id self explained
      */
     void start_download_task(size_t unique_id);
@@ -116,19 +265,72 @@ signals:
 
 private:
     size_t append(QNetworkRequest const &request, QString const &save_at, int timeout_msec, bool save_as_file);
+    void acquire_host(QString const &host);
+    void apply_bandwidth();
+    void connect_reply(std::shared_ptr<download_task> task, QNetworkReply *reply);
+    void dequeue(download_task &task);
     void download_start(std::shared_ptr<download_task> task);
+    void finish_task(std::shared_ptr<download_task> task);
+    void enqueue(std::shared_ptr<download_task> task);
     void handle_download_finished();
     void handle_download_progress(qint64 bytesReceived, qint64 bytesTotal);
     void handle_error(QNetworkReply::NetworkError code);
+    void handle_meta_data_changed();
+    void handle_probe_finished();
     void handle_ready_read();
+    void handle_segment_finished(std::shared_ptr<download_task> task, QNetworkReply *reply);
+    void handle_throttle_timeout();
+    void handle_write_error(std::shared_ptr<download_task> task, QNetworkReply *reply);
+    bool host_full(QString const &host) const;
+    QString host_key(QUrl const &url) const;
     void launch_download_task(std::shared_ptr<download_task> task);
+    void launch_probe(std::shared_ptr<download_task> task);
+    void launch_segments(std::shared_ptr<download_task> task);
+    bool open_file(download_task &task);
+    void read_reply(QNetworkReply *reply, bool drain);
+    void release_host(QString const &host);
+    bool should_resume(download_task const &task) const;
     void restart_timer(download_task &task);    
+    void start_queued(std::shared_ptr<download_task> task);
+    void throttle(download_task &task, QNetworkReply *reply);
+    void update_host_rings();
     void start_next_download();    
 
-    std::map<size_t, std::shared_ptr<download_task>> id_table_;
+    using task_queue = std::list<std::shared_ptr<download_task>>;
+
+    //queued tasks of one host at one priority
+    struct host_queue
+    {
+        bool in_ring_ = false;
+        std::list<QString>::iterator ring_pos_; //valid if in_ring_
+        task_queue tasks_;
+    };
+
+    //queued tasks of one priority, the hosts below their limit are
+    //served in turn from the ring
+    struct priority_level
+    {
+        std::unordered_map<QString, host_queue> hosts_;
+        std::list<QString> ring_;
+    };
+
+    token_bucket bandwidth_;
+    std::unordered_map<size_t, std::shared_ptr<download_task>> id_table_;
+    std::unordered_map<QString, size_t> domain_limits_;
+    std::unordered_map<QString, token_bucket> host_bandwidth_;
+    std::unordered_map<QString, size_t> host_running_;
+    bool idle_; //no task started since all_download_finished
     size_t max_download_file_;
+    size_t max_download_per_host_;
+    int max_resume_attempts_;
+    int max_segments_;
     QNetworkAccessManager *network_access_;
+    //queued tasks by priority, round robin between hosts and first
+    //in first out within a host
+    std::map<int, priority_level, std::greater<int>> ready_queue_;
     std::map<QNetworkReply*, std::shared_ptr<download_task>> reply_table_;
+    QTimer throttle_timer_;
+    std::vector<QNetworkReply*> throttled_; //replies waiting for tokens
     size_t total_download_file_;
     size_t unique_id_;
 };
@@ -0,0 +1,9 @@
+#sources of download_supervisor, shared by the library and the self check
+
+SOURCES += $$PWD/download_supervisor.cpp \
+    $$PWD/token_bucket.cpp \
+    $$PWD/../utility/qte_utility.cpp
+
+HEADERS += $$PWD/download_supervisor.hpp \
+    $$PWD/token_bucket.hpp \
+    $$PWD/../utility/qte_utility.hpp
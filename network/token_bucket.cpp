@@ -0,0 +1,113 @@
+#include "token_bucket.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace qte{
+
+namespace net{
+
+namespace{
+
+//the effective rate is sampled at least every half second
+qint64 const rate_window = 500 * 1000 * 1000;
+
+}
+
+token_bucket::token_bucket(qint64 rate, qint64 burst) :
+    burst_(0),
+    effective_rate_(0),
+    last_refill_(0),
+    rate_(0),
+    tokens_(0),
+    window_bytes_(0),
+    window_start_(0)
+{
+    timer_.start();
+    set_rate(rate, burst);
+}
+
+qint64 token_bucket::available()
+{
+    if(rate_ <= 0){
+        return std::numeric_limits<qint64>::max();
+    }
+
+    refill();
+    return tokens_ > 0 ? static_cast<qint64>(tokens_) : 0;
+}
+
+void token_bucket::consume(qint64 bytes)
+{
+    if(rate_ > 0){
+        refill();
+        tokens_ -= static_cast<double>(bytes);
+    }
+
+    window_bytes_ += bytes;
+    qint64 const now = timer_.nsecsElapsed();
+    if(now - window_start_ >= rate_window){
+        double const rate = window_bytes_ * 1e9 / (now - window_start_);
+        effective_rate_ = effective_rate_ == 0 ? rate : effective_rate_ * 0.5 + rate * 0.5;
+        window_bytes_ = 0;
+        window_start_ = now;
+    }
+}
+
+qint64 token_bucket::get_burst() const
+{
+    return burst_;
+}
+
+double token_bucket::get_effective_rate() const
+{
+    //the window idle for long is more recent than the average
+    qint64 const elapsed = timer_.nsecsElapsed() - window_start_;
+    if(elapsed >= 2 * rate_window){
+        return window_bytes_ * 1e9 / elapsed;
+    }
+
+    return effective_rate_;
+}
+
+qint64 token_bucket::get_rate() const
+{
+    return rate_;
+}
+
+qint64 token_bucket::msec_until(qint64 bytes)
+{
+    if(rate_ <= 0){
+        return 0;
+    }
+
+    refill();
+    double const lack = static_cast<double>(std::min(bytes, burst_)) - tokens_;
+    return lack > 0 ? static_cast<qint64>(std::ceil(lack * 1000 / rate_)) : 0;
+}
+
+void token_bucket::set_rate(qint64 rate, qint64 burst)
+{
+    bool const was_limited = rate_ > 0;
+    refill();
+    rate_ = std::max<qint64>(0, rate);
+    burst_ = burst > 0 ? burst : rate_;
+    //a new limit start with a full bucket
+    tokens_ = was_limited ? std::min(tokens_, static_cast<double>(burst_)) :
+                            static_cast<double>(burst_);
+}
+
+void token_bucket::refill()
+{
+    qint64 const now = timer_.nsecsElapsed();
+    if(rate_ > 0){
+        tokens_ = std::min(static_cast<double>(burst_),
+                           tokens_ + static_cast<double>(rate_) * (now - last_refill_) / 1e9);
+    }
+    last_refill_ = now;
+}
+
+}
+
+}
@@ -0,0 +1,75 @@
+#ifndef QTE_NET_TOKEN_BUCKET_HPP
+#define QTE_NET_TOKEN_BUCKET_HPP
+
+#include <QElapsedTimer>
+
+namespace qte{
+
+namespace net{
+
+/**
+ * Limit the rate of the bytes passing through, the bucket is refilled by
+ * rate bytes per second and hold at most burst bytes, so the traffic can
+ * exceed the rate for a short time after idle. The bytes consumed are
+ * measured to report the effective rate. Not thread safe
+ */
+class token_bucket
+{
+public:
+    /**
+     * @param rate bytes per second, <= 0 means no limit
+     * @param burst capacity of the bucket, <= 0 means one second of rate
+     */
+    explicit token_bucket(qint64 rate = 0, qint64 burst = 0);
+
+    /**
+     * @return bytes can be consumed now, max of qint64 if no limit
+     */
+    qint64 available();
+
+    /**
+     * Take bytes out of the bucket, bytes more than available are
+     * allowed and paid back by the following refill
+     */
+    void consume(qint64 bytes);
+
+    qint64 get_burst() const;
+
+    /**
+     * @return bytes per second consumed recently, no matter limited or not
+     */
+    double get_effective_rate() const;
+
+    qint64 get_rate() const;
+
+    /**
+     * @return milliseconds until bytes(no more than burst) can be consumed
+     */
+    qint64 msec_until(qint64 bytes);
+
+    /**
+     * Change the rate, the tokens already in the bucket are kept up to
+     * the new burst, so the traffic do not stall or spike
+     * @param rate bytes per second, <= 0 means no limit
+     * @param burst capacity of the bucket, <= 0 means one second of rate
+     */
+    void set_rate(qint64 rate, qint64 burst = 0);
+
+private:
+    void refill();
+
+    qint64 burst_;
+    double effective_rate_;
+    qint64 last_refill_; //nsecs of timer_
+    qint64 rate_;
+    QElapsedTimer timer_;
+    double tokens_;
+    qint64 window_bytes_; //bytes consumed since window_start_
+    qint64 window_start_; //nsecs of timer_
+};
+
+}
+
+}
+
+#endif // QTE_NET_TOKEN_BUCKET_HPP
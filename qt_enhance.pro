@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += widgets network core
+QT       += widgets network core concurrent
 
 TARGET = qt_enhance
 TEMPLATE = lib
@@ -12,6 +12,10 @@ CONFIG += staticlib
 
 include(../pri/boost.pri)
 
+include(compressor/compressor.pri)
+
+include(network/download_supervisor.pri)
+
 SOURCES += gui/img_region_selector.cpp \
     gui/rubber_band.cpp \
     network/download_info.cpp \
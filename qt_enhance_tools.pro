@@ -0,0 +1,13 @@
+#-------------------------------------------------
+#
+# Self check of the compressor module and download_supervisor, and
+# benchmark of the compressor module. They build the sources of the
+# modules themselves and do not need the library
+# usage : qmake qt_enhance_tools.pro && make && make check
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += benchmark \
+    selfcheck
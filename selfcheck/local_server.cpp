@@ -0,0 +1,241 @@
+#include "local_server.hpp"
+
+#include <QCryptographicHash>
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <algorithm>
+
+namespace qte{
+
+namespace check{
+
+namespace{
+
+qint64 const chunk_size = 64 * 1024;
+
+QByteArray make_etag(QByteArray const &data)
+{
+    return "\"" + QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex() + "\"";
+}
+
+}
+
+struct local_server::connection
+{
+    QByteArray body_;
+    qint64 body_end_ = 0; //the connection is closed after the body is sent to here
+    QByteArray buffer_; //the request not parsed yet
+    bool finished_ = false;
+    QString host_;
+    qint64 sent_ = 0;
+    bool serving_ = false;
+    QTcpSocket *socket_ = nullptr;
+};
+
+local_server::local_server() :
+    chunk_delay_(0),
+    max_running_(0),
+    running_(0)
+{
+    QObject::connect(&server_, &QTcpServer::newConnection, &server_, [this]()
+    {
+        while(QTcpSocket *socket = server_.nextPendingConnection()){
+            auto conn = std::make_shared<connection>();
+            conn->socket_ = socket;
+            QObject::connect(socket, &QTcpSocket::readyRead, socket, [this, conn]()
+            {
+                read_request(conn);
+            });
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, [this, conn]()
+            {
+                finish(*conn);
+                conn->socket_->deleteLater();
+            });
+        }
+    });
+}
+
+local_server::~local_server()
+{
+    server_.close();
+}
+
+void local_server::add_resource(QString const &path, QByteArray const &data)
+{
+    resources_[path] = data;
+}
+
+void local_server::break_after(QString const &path, qint64 bytes, int count)
+{
+    breaks_[path] = {bytes, count};
+}
+
+bool local_server::listen()
+{
+    return server_.listen(QHostAddress::Any);
+}
+
+int local_server::max_concurrent() const
+{
+    return max_running_;
+}
+
+int local_server::max_concurrent(QString const &host) const
+{
+    auto it = max_running_per_host_.find(host);
+    return it != std::end(max_running_per_host_) ? it->second : 0;
+}
+
+quint16 local_server::port() const
+{
+    return server_.serverPort();
+}
+
+std::vector<QByteArray> const& local_server::ranges() const
+{
+    return ranges_;
+}
+
+void local_server::reset_statistics()
+{
+    max_running_ = running_;
+    max_running_per_host_ = running_per_host_;
+    ranges_.clear();
+}
+
+void local_server::set_chunk_delay(int msec)
+{
+    chunk_delay_ = msec;
+}
+
+void local_server::finish(connection &conn)
+{
+    if(conn.serving_ && !conn.finished_){
+        conn.finished_ = true;
+        --running_;
+        --running_per_host_[conn.host_];
+    }
+}
+
+void local_server::read_request(std::shared_ptr<connection> conn)
+{
+    conn->buffer_ += conn->socket_->readAll();
+    int const header_end = conn->buffer_.indexOf("\r\n\r\n");
+    if(conn->serving_ || header_end < 0){
+        return;
+    }
+
+    QList<QByteArray> const lines = conn->buffer_.left(header_end).split('\n');
+    QList<QByteArray> const request_line = lines.front().trimmed().split(' ');
+    std::map<QByteArray, QByteArray> headers;
+    for(int i = 1; i < lines.size(); ++i){
+        int const colon = lines[i].indexOf(':');
+        if(colon > 0){
+            headers[lines[i].left(colon).trimmed().toLower()] = lines[i].mid(colon + 1).trimmed();
+        }
+    }
+    QByteArray const host = headers["host"];
+    int const port_separator = host.lastIndexOf(':');
+    conn->host_ = QString::fromLatin1(port_separator > 0 && !host.endsWith(']') ?
+                                          host.left(port_separator) : host);
+    conn->serving_ = true;
+    ++running_;
+    max_running_ = std::max(max_running_, running_);
+    int &host_running = running_per_host_[conn->host_];
+    ++host_running;
+    int &host_max = max_running_per_host_[conn->host_];
+    host_max = std::max(host_max, host_running);
+
+    respond(conn, request_line.value(0), QString::fromLatin1(request_line.value(1)), headers);
+}
+
+void local_server::respond(std::shared_ptr<connection> conn, QByteArray const &method,
+                           QString const &path, std::map<QByteArray, QByteArray> const &headers)
+{
+    auto it = resources_.find(path);
+    if(it == std::end(resources_) || (method != "GET" && method != "HEAD")){
+        conn->socket_->write("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+                             "Connection: close\r\n\r\n");
+        send_chunk(conn);
+        return;
+    }
+
+    //the range is ignored if the resource is changed, the whole
+    //resource is sent instead
+    QByteArray const &data = it->second;
+    QByteArray const etag = make_etag(data);
+    auto const range_it = headers.find("range");
+    auto const if_range_it = headers.find("if-range");
+    QByteArray const range = range_it != std::end(headers) ? range_it->second : QByteArray();
+    if(!range.isEmpty()){
+        ranges_.push_back(range);
+    }
+    qint64 first = 0;
+    qint64 last = data.size() - 1;
+    bool const partial = range.startsWith("bytes=") &&
+            (if_range_it == std::end(headers) || if_range_it->second == etag);
+    if(partial){
+        QList<QByteArray> const bounds = range.mid(6).split('-');
+        first = bounds.value(0).toLongLong();
+        if(!bounds.value(1).isEmpty()){
+            last = std::min(last, bounds.value(1).toLongLong());
+        }
+        if(first > last){
+            conn->socket_->write("HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n"
+                                 "Connection: close\r\n\r\n");
+            send_chunk(conn);
+            return;
+        }
+    }
+
+    QByteArray header = partial ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+    header += "Accept-Ranges: bytes\r\nConnection: close\r\n";
+    header += "Content-Length: " + QByteArray::number(last - first + 1) + "\r\n";
+    header += "ETag: " + etag + "\r\n";
+    if(partial){
+        header += "Content-Range: bytes " + QByteArray::number(first) + "-" +
+                QByteArray::number(last) + "/" + QByteArray::number(data.size()) + "\r\n";
+    }
+    conn->socket_->write(header + "\r\n");
+    if(method == "GET"){
+        conn->body_ = data.mid(static_cast<int>(first), static_cast<int>(last - first + 1));
+        conn->body_end_ = conn->body_.size();
+        auto break_it = breaks_.find(path);
+        if(break_it != std::end(breaks_) && break_it->second.second > 0){
+            --break_it->second.second;
+            conn->body_end_ = std::min(conn->body_end_, break_it->second.first);
+        }
+    }
+    send_chunk(conn);
+}
+
+void local_server::send_chunk(std::shared_ptr<connection> conn)
+{
+    if(conn->socket_->state() != QAbstractSocket::ConnectedState){
+        return;
+    }
+
+    qint64 const size = std::min(chunk_size, conn->body_end_ - conn->sent_);
+    if(size > 0){
+        conn->socket_->write(conn->body_.constData() + conn->sent_, size);
+        conn->sent_ += size;
+    }
+    if(conn->sent_ == conn->body_end_){
+        //the request is served once the data is handed to the socket,
+        //the written data is sent before the connection is closed
+        finish(*conn);
+        conn->socket_->disconnectFromHost();
+        return;
+    }
+
+    QTimer::singleShot(chunk_delay_, conn->socket_, [this, conn]()
+    {
+        send_chunk(conn);
+    });
+}
+
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef QTE_CHECK_LOCAL_SERVER_HPP
+#define QTE_CHECK_LOCAL_SERVER_HPP
+
+#include <QByteArray>
+#include <QString>
+#include <QTcpServer>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace qte{
+
+namespace check{
+
+/**
+ * HTTP/1.1 server on the local machine for the checks of
+ * download_supervisor. The resources are served by GET and HEAD with
+ * "Range" and "If-Range", the body is sent in chunks so the downloads
+ * overlap, and the connection can be closed in the middle of a body to
+ * simulate a broken download. Every response close the connection
+ */
+class local_server
+{
+public:
+    local_server();
+    ~local_server();
+
+    /**
+     * @param path path of the url, begin with "/"
+     * @param data content of the resource, the ETag change with it
+     */
+    void add_resource(QString const &path, QByteArray const &data);
+
+    /**
+     * The next count GET of the path close the connection after bytes
+     * of the body are sent
+     */
+    void break_after(QString const &path, qint64 bytes, int count = 1);
+
+    /**
+     * Listen on a free port of every address of the local machine, so
+     * "127.0.0.1" and "localhost" are two hosts of the same server
+     * @return true if success and vice versa
+     */
+    bool listen();
+
+    /**
+     * @return the most requests served at the same time
+     */
+    int max_concurrent() const;
+
+    /**
+     * @return the most requests of the host served at the same time,
+     * the host is the "Host" header without port
+     */
+    int max_concurrent(QString const &host) const;
+
+    quint16 port() const;
+
+    /**
+     * @return the "Range" headers received since the last reset, in order
+     */
+    std::vector<QByteArray> const& ranges() const;
+
+    /**
+     * Clear the statistics of concurrency and ranges
+     */
+    void reset_statistics();
+
+    /**
+     * Wait msec before every chunk(64KB) of the body is sent. Default
+     * value is 0
+     */
+    void set_chunk_delay(int msec);
+
+private:
+    struct connection;
+
+    void finish(connection &conn);
+    void read_request(std::shared_ptr<connection> conn);
+    void respond(std::shared_ptr<connection> conn, QByteArray const &method,
+                 QString const &path, std::map<QByteArray, QByteArray> const &headers);
+    void send_chunk(std::shared_ptr<connection> conn);
+
+    //path -> bytes sent before close and how many GET are broken
+    std::map<QString, std::pair<qint64, int>> breaks_;
+    int chunk_delay_;
+    int max_running_;
+    std::map<QString, int> max_running_per_host_;
+    std::vector<QByteArray> ranges_;
+    std::map<QString, QByteArray> resources_;
+    int running_;
+    std::map<QString, int> running_per_host_;
+    QTcpServer server_;
+};
+
+}
+
+}
+
+#endif // QTE_CHECK_LOCAL_SERVER_HPP
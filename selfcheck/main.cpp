@@ -0,0 +1,750 @@
+#include "../compressor/adaptive_level.hpp"
+#include "../compressor/archive_fs.hpp"
+#include "../compressor/archive_job.hpp"
+#include "../compressor/checksum.hpp"
+#include "../compressor/codec.hpp"
+#include "../compressor/compress_device.hpp"
+#include "../compressor/file_compressor.hpp"
+#include "../compressor/folder_compressor.hpp"
+#include "../compressor/folder_scanner.hpp"
+#include "../network/download_supervisor.hpp"
+#include "local_server.hpp"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkRequest>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+#include <QUrl>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace qte;
+
+namespace{
+
+int failures = 0;
+
+void check(bool condition, QString const &name)
+{
+    QTextStream out(stdout);
+    out<<(condition ? "pass " : "FAIL ")<<name<<Qt::endl;
+    if(!condition){
+        ++failures;
+    }
+}
+
+//Text like data which compress well, followed by random bytes
+//which cannot shrink
+QByteArray make_data(quint32 seed, int size)
+{
+    std::mt19937 engine(seed);
+    QByteArray data;
+    data.reserve(size);
+    while(data.size() < size / 2){
+        data += QByteArray("line ") + QByteArray::number(engine() % 1000) + "\n";
+    }
+    while(data.size() < size){
+        data.append(static_cast<char>(engine() & 0xFF));
+    }
+    data.resize(size);
+
+    return data;
+}
+
+bool write_file(QString const &path, QByteArray const &data)
+{
+    QFile file(path);
+    return QDir().mkpath(QFileInfo(path).absolutePath()) &&
+            file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+QByteArray read_file(QString const &path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+//relative path and content of every file under the folder
+std::map<QString, QByteArray> read_folder(QString const &folder)
+{
+    std::map<QString, QByteArray> files;
+    QDir const dir(folder);
+    QDirIterator it(folder, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while(it.hasNext()){
+        QString const path = it.next();
+        files[dir.relativeFilePath(path)] = read_file(path);
+    }
+
+    return files;
+}
+
+bool same_folder(QString const &lhs, QString const &rhs)
+{
+    auto const files = read_folder(lhs);
+    return !files.empty() && files == read_folder(rhs);
+}
+
+//A folder with nested files, duplicated files and an empty file
+bool make_folder(QString const &folder)
+{
+    return write_file(folder + "/a.txt", make_data(1, 3000)) &&
+            write_file(folder + "/copy_of_a.txt", make_data(1, 3000)) &&
+            write_file(folder + "/empty.txt", {}) &&
+            write_file(folder + "/sub/b.bin", make_data(2, 200 * 1024)) &&
+            write_file(folder + "/sub/deep/c.txt", make_data(3, 5000)) &&
+            write_file(folder + "/sub/deep/copy_of_c.txt", make_data(3, 5000));
+}
+
+QString codec_name(cp::codec_id id)
+{
+    switch(id){
+    case cp::codec_id::lz4: return "lz4";
+    case cp::codec_id::zstd: return "zstd";
+    default: return "zlib";
+    }
+}
+
+void check_stream(QString const &work_dir)
+{
+    QString const source = work_dir + "/stream_source.bin";
+    QString const compressed = work_dir + "/stream.qtec";
+    QString const restored = work_dir + "/stream_restored.bin";
+    QByteArray const data = make_data(4, 1024 * 1024 + 123);
+    write_file(source, data);
+    for(auto const codec : cp::available_codecs()){
+        for(int const thread_count : {1, 4}){
+            QString const name = QString("stream %1 threads %2").arg(codec_name(codec)).arg(thread_count);
+            check(cp::compress(source, compressed, 6, 64 * 1024, thread_count, codec) &&
+                  cp::decompress(compressed, restored, thread_count) &&
+                  read_file(restored) == data, name + " round trip");
+        }
+    }
+
+    write_file(source, {});
+    check(cp::compress(source, compressed) && cp::decompress(compressed, restored) &&
+          QFileInfo(restored).size() == 0, "stream empty file round trip");
+
+    //the format before the stream is a single qCompress blob
+    write_file(compressed, qCompress(data, 9));
+    check(cp::decompress(compressed, restored) && read_file(restored) == data,
+          "stream read old format");
+
+    //the stream is cut in the middle of a block
+    write_file(source, data);
+    cp::compress(source, compressed, 6, 64 * 1024);
+    QByteArray const packed = read_file(compressed);
+    write_file(compressed, packed.left(packed.size() / 2));
+    check(!cp::decompress(compressed, restored), "stream reject truncated file");
+
+    //the random data is stored, only the headers are added
+    QByteArray random_data(1024 * 1024, Qt::Uninitialized);
+    std::mt19937 engine(5);
+    for(char &c : random_data){
+        c = static_cast<char>(engine() & 0xFF);
+    }
+    write_file(source, random_data);
+    check(cp::compress(source, compressed, 9, 64 * 1024) &&
+          QFileInfo(compressed).size() < random_data.size() + 256 &&
+          cp::decompress(compressed, restored) && read_file(restored) == random_data,
+          "stream store incompressible blocks");
+}
+
+void check_adaptive_level(QString const &work_dir)
+{
+    QString const source = work_dir + "/adaptive_source.bin";
+    QString const compressed = work_dir + "/adaptive.qtec";
+    QString const restored = work_dir + "/adaptive_restored.bin";
+    QByteArray const data = make_data(6, 1024 * 1024);
+    write_file(source, data);
+    cp::adaptive_level level;
+    level.set_target_throughput(50);
+    check(cp::compress(source, compressed, level, 64 * 1024, 2) &&
+          cp::decompress(compressed, restored, 2) && read_file(restored) == data,
+          "stream adaptive level round trip");
+
+    //without target the highest level of the codec is used
+    for(auto const id : cp::available_codecs()){
+        cp::adaptive_level full;
+        check(cp::compress(source, compressed, full, 64 * 1024, 2, id) &&
+              full.level() == cp::find_codec(id)->max_level(),
+              "stream adaptive level range of " + codec_name(id));
+    }
+}
+
+void check_device()
+{
+    QByteArray const data = make_data(7, 300 * 1024);
+    QBuffer packed;
+    packed.open(QIODevice::WriteOnly);
+    cp::compress_device writer(&packed, 6, 64 * 1024);
+    bool const written = writer.open(QIODevice::WriteOnly) &&
+            writer.write(data) == data.size();
+    writer.close();
+    check(written && !writer.has_error(), "device compress");
+
+    packed.close();
+    packed.open(QIODevice::ReadOnly);
+    cp::decompress_device reader(&packed);
+    check(reader.open(QIODevice::ReadOnly) && reader.readAll() == data,
+          "device round trip");
+
+    //the block is decompressed when the source got it, before the read
+    QBuffer arrived;
+    arrived.setData(packed.data());
+    arrived.open(QIODevice::ReadOnly);
+    cp::decompress_device arrived_reader(&arrived);
+    bool const opened = arrived_reader.open(QIODevice::ReadOnly);
+    emit arrived.readyRead();
+    check(opened && arrived_reader.bytesAvailable() == 64 * 1024 &&
+          arrived_reader.read(64 * 1024) == data.left(64 * 1024) &&
+          arrived_reader.bytesAvailable() == 64 * 1024,
+          "device bytes available before read");
+
+    QBuffer truncated;
+    truncated.setData(packed.data().left(packed.data().size() / 2));
+    truncated.open(QIODevice::ReadOnly);
+    cp::decompress_device truncated_reader(&truncated);
+    check(truncated_reader.open(QIODevice::ReadOnly) &&
+          truncated_reader.readAll().size() < data.size() &&
+          truncated_reader.errorString() == "Truncated stream",
+          "device reject truncated stream");
+}
+
+void check_archive(QString const &work_dir)
+{
+    QString const source = work_dir + "/archive_source";
+    QString const archive = work_dir + "/archive.qtea";
+    QString const restored = work_dir + "/archive_restored";
+    if(!make_folder(source)){
+        check(false, "archive create source folder");
+        return;
+    }
+
+    cp::folder_compressor compressor;
+    check(compressor.compress_folder(source, archive) &&
+          compressor.decompress_folder(archive, restored) &&
+          same_folder(source, restored), "archive round trip");
+    QDir(restored).removeRecursively();
+
+    cp::folder_compressor parallel;
+    parallel.set_thread_count(4);
+    check(parallel.compress_folder(source, archive) &&
+          parallel.decompress_folder(archive, restored) &&
+          same_folder(source, restored), "archive threads 4 round trip");
+    QDir(restored).removeRecursively();
+
+    for(auto const codec : cp::available_codecs()){
+        cp::folder_compressor codec_compressor;
+        codec_compressor.set_codec(codec);
+        check(codec_compressor.compress_folder(source, archive) &&
+              codec_compressor.decompress_folder(archive, restored) &&
+              same_folder(source, restored),
+              QString("archive %1 round trip").arg(codec_name(codec)));
+        QDir(restored).removeRecursively();
+    }
+
+    QString const extracted = work_dir + "/extracted.txt";
+    check(compressor.extract_entry(archive, "/sub/deep/c.txt", extracted) &&
+          read_file(extracted) == read_file(source + "/sub/deep/c.txt"),
+          "archive extract one entry");
+}
+
+void check_legacy_archive(QString const &work_dir)
+{
+    //the archive before the central directory is a row of name and
+    //qCompress data
+    QString const archive = work_dir + "/legacy.qtea";
+    QString const restored = work_dir + "/legacy_restored";
+    QString const expected = work_dir + "/legacy_expected";
+    QFile file(archive);
+    if(!file.open(QIODevice::WriteOnly)){
+        check(false, "legacy archive create");
+        return;
+    }
+    QDataStream out(&file);
+    std::map<QString, QByteArray> const files{{"/a.txt", make_data(11, 3000)},
+                                              {"/sub/b.bin", make_data(12, 70 * 1024)},
+                                              {"/sub/empty.txt", {}}};
+    for(auto const &pair : files){
+        out<<pair.first<<qCompress(pair.second, 9);
+        write_file(expected + pair.first, pair.second);
+    }
+    file.close();
+
+    cp::folder_compressor compressor;
+    std::vector<cp::archive_entry> entries;
+    check(compressor.list_entries(archive, entries) && entries.size() == files.size(),
+          "legacy archive list");
+    check(compressor.decompress_folder(archive, restored) &&
+          same_folder(expected, restored), "legacy archive read");
+}
+
+void check_solid(QString const &work_dir)
+{
+    QString const source = work_dir + "/solid_source";
+    QString const archive = work_dir + "/solid.qtea";
+    QString const restored = work_dir + "/solid_restored";
+    make_folder(source);
+    for(auto const codec : cp::available_codecs()){
+        cp::folder_compressor compressor;
+        compressor.set_codec(codec);
+        compressor.set_solid_block_size(64 * 1024);
+        compressor.set_thread_count(4);
+        check(compressor.compress_folder(source, archive) &&
+              compressor.decompress_folder(archive, restored) &&
+              same_folder(source, restored),
+              QString("archive %1 solid round trip").arg(codec_name(codec)));
+        QDir(restored).removeRecursively();
+    }
+
+    cp::folder_compressor compressor;
+    QString const extracted = work_dir + "/solid_extracted.txt";
+    check(compressor.extract_entry(archive, "/a.txt", extracted) &&
+          read_file(extracted) == read_file(source + "/a.txt"),
+          "archive extract one solid entry");
+}
+
+void check_incremental(QString const &work_dir)
+{
+    QString const source = work_dir + "/incremental_source";
+    QString const baseline = work_dir + "/baseline.qtea";
+    QString const archive = work_dir + "/incremental.qtea";
+    QString const restored = work_dir + "/incremental_restored";
+    make_folder(source);
+    cp::folder_compressor compressor;
+    compressor.compress_folder(source, baseline);
+
+    //only the changed file is compressed again, the archive still
+    //restore the whole folder
+    write_file(source + "/a.txt", make_data(13, 4000));
+    write_file(source + "/sub/new.txt", make_data(14, 2000));
+    check(compressor.compress_folder_incremental(source, baseline, archive) &&
+          compressor.decompress_folder(archive, restored) &&
+          same_folder(source, restored), "archive incremental");
+}
+
+void check_deduplicate(QString const &work_dir)
+{
+    QString const source = work_dir + "/dedup_source";
+    QString const archive = work_dir + "/dedup.qtea";
+    QString const restored = work_dir + "/dedup_restored";
+    make_folder(source);
+    cp::folder_compressor compressor;
+    compressor.set_deduplicate(true);
+    compressor.set_thread_count(4);
+    std::vector<cp::archive_entry> entries;
+    check(compressor.compress_folder(source, archive) &&
+          compressor.decompress_folder(archive, restored) &&
+          same_folder(source, restored) && compressor.list_entries(archive, entries),
+          "archive deduplicate round trip");
+
+    //the copies refer to the data of the first file
+    std::map<QString, cp::archive_entry> by_name;
+    for(auto const &entry : entries){
+        by_name[entry.name_] = entry;
+    }
+    check(by_name["/a.txt"].offset_ == by_name["/copy_of_a.txt"].offset_ &&
+          by_name["/sub/deep/c.txt"].offset_ == by_name["/sub/deep/copy_of_c.txt"].offset_,
+          "archive deduplicate share data");
+    QDir(restored).removeRecursively();
+
+    compressor.set_solid_block_size(64 * 1024);
+    check(compressor.compress_folder(source, archive) &&
+          compressor.decompress_folder(archive, restored) &&
+          same_folder(source, restored), "archive deduplicate and solid round trip");
+}
+
+void check_verify(QString const &work_dir)
+{
+    QString const source = work_dir + "/verify_source";
+    QString const archive = work_dir + "/verify.qtea";
+    QString const damaged_archive = work_dir + "/damaged.qtea";
+    make_folder(source);
+    cp::folder_compressor compressor;
+    compressor.set_thread_count(4);
+    QStringList corrupted;
+    check(compressor.compress_folder(source, archive) &&
+          compressor.verify(archive, corrupted) && corrupted.isEmpty(),
+          "archive verify intact");
+
+    //flip a byte in the data of the first non empty entry
+    std::vector<cp::archive_entry> entries;
+    compressor.list_entries(archive, entries);
+    QByteArray damaged = read_file(archive);
+    for(auto const &entry : entries){
+        if(entry.raw_size_ > 0 && entry.packed_size_ > 0){
+            int const pos = static_cast<int>(entry.offset_ + entry.packed_size_ / 2);
+            damaged[pos] = static_cast<char>(~damaged[pos]);
+            break;
+        }
+    }
+    write_file(damaged_archive, damaged);
+    check(!compressor.verify(damaged_archive, corrupted) && corrupted.size() == 1,
+          "archive verify corrupted");
+
+    write_file(damaged_archive, read_file(archive).left(QFileInfo(archive).size() / 2));
+    check(!compressor.verify(damaged_archive), "archive verify truncated");
+}
+
+void check_job(QString const &work_dir)
+{
+    QString const source = work_dir + "/job_source";
+    QString const archive = work_dir + "/job.qtea";
+    QString const restored = work_dir + "/job_restored";
+    make_folder(source);
+    cp::archive_job job;
+    QFuture<bool> compress = job.compress_folder(source, archive, {}, 6);
+    compress.waitForFinished();
+    QFuture<bool> decompress = job.decompress_folder(archive, restored);
+    decompress.waitForFinished();
+    check(compress.result() && decompress.result() && same_folder(source, restored),
+          "archive job round trip");
+}
+
+void check_append(QString const &work_dir)
+{
+    QString const source = work_dir + "/append_source";
+    QString const archive = work_dir + "/append.qtea";
+    QString const restored = work_dir + "/append_restored";
+    make_folder(source);
+    cp::folder_compressor compressor;
+    compressor.compress_folder(source, archive);
+
+    //the new file is added, the changed file is replaced
+    write_file(source + "/sub/new.txt", make_data(15, 2000));
+    write_file(source + "/a.txt", make_data(16, 2500));
+    check(compressor.append_files(archive, source, {"sub/new.txt", source + "/a.txt"}) &&
+          compressor.decompress_folder(archive, restored) &&
+          same_folder(source, restored) && compressor.verify(archive),
+          "archive append");
+
+    //the incomplete data left by an interrupted append is reported by
+    //the readers, and overwritten by the next append
+    QFile tail(archive);
+    tail.open(QIODevice::Append);
+    tail.write(make_data(18, 3000));
+    tail.close();
+    check(!compressor.verify(archive) && !compressor.decompress_folder(archive, restored),
+          "interrupted append is reported");
+    check(compressor.append_files(archive, source, {"sub/new.txt"}) &&
+          compressor.verify(archive),
+          "append after interrupted append");
+
+    write_file(work_dir + "/outside.txt", make_data(17, 100));
+    check(!compressor.append_files(archive, source, {"../outside.txt"}),
+          "archive append reject file outside the folder");
+}
+
+void check_append_version6(QString const &work_dir)
+{
+    //the archive of version 6 has one stored entry and the trailer
+    //without version, the header keep the version after appended
+    QString const source = work_dir + "/append6_source";
+    QString const archive = work_dir + "/append6.qtea";
+    QString const restored = work_dir + "/append6_restored";
+    QByteArray const content = make_data(20, 1000);
+    write_file(source + "/old.txt", content);
+    QFile file(archive);
+    if(!file.open(QIODevice::WriteOnly)){
+        check(false, "archive version 6 create");
+        return;
+    }
+    QDataStream out(&file);
+    out<<quint32(0x51544541)<<quint16(6);
+    quint64 const offset = static_cast<quint64>(file.pos());
+    out.writeRawData(content.constData(), content.size());
+    quint64 const directory_offset = static_cast<quint64>(file.pos());
+    out<<quint32(1)<<QString("/old.txt")<<offset<<quint64(content.size())
+      <<quint64(content.size())<<cp::crc32c(content)<<quint8(0x01)<<quint8(0)
+      <<quint64(0)<<quint64(0)<<qint64(0);
+    out<<directory_offset<<quint32(0x51544544);
+    file.close();
+
+    cp::folder_compressor compressor;
+    write_file(source + "/a.txt", make_data(21, 2000));
+    check(compressor.append_files(archive, source, {"a.txt"}) &&
+          compressor.verify(archive), "archive version 6 append");
+
+    //the tail of an interrupted append is dropped by the next append,
+    //the directories of both versions are still read
+    QFile tail(archive);
+    tail.open(QIODevice::Append);
+    tail.write(make_data(22, 3000));
+    tail.close();
+    write_file(source + "/b.txt", make_data(23, 2000));
+    check(compressor.append_files(archive, source, {"b.txt"}) &&
+          compressor.decompress_folder(archive, restored) &&
+          same_folder(source, restored) && compressor.verify(archive),
+          "archive version 6 append after interrupted append");
+}
+
+void check_exclude(QString const &work_dir)
+{
+    QString const source = work_dir + "/exclude_source";
+    QString const archive = work_dir + "/exclude.qtea";
+    QString const restored = work_dir + "/exclude_restored";
+    make_folder(source);
+    check(cp::folder_scanner({"*.bin"}).is_excluded("b.bin") &&
+          !cp::folder_scanner({"*.bin"}).is_excluded("a.txt"), "scanner wildcard");
+
+    //the wildcard apply to the files at every depth
+    cp::folder_compressor compressor;
+    check(compressor.compress_folder(source, archive, {"*.bin", "deep"}) &&
+          compressor.decompress_folder(archive, restored) &&
+          read_folder(restored).size() == 3 && !QFile::exists(restored + "/sub/b.bin"),
+          "archive exclude");
+}
+
+void check_sync(QString const &work_dir)
+{
+    QString const source = work_dir + "/sync_source";
+    QString const archive = work_dir + "/sync.qtea";
+    QString const restored = work_dir + "/sync_restored";
+    make_folder(source);
+    cp::folder_compressor compressor;
+    compressor.compress_folder(source, archive);
+    compressor.decompress_folder(archive, restored);
+
+    //the changed file is restored, the extra file is removed
+    write_file(restored + "/sub/deep/c.txt", make_data(18, 5000));
+    write_file(restored + "/extra.txt", make_data(19, 100));
+    check(compressor.sync_folder(archive, restored, true) &&
+          same_folder(source, restored), "archive sync");
+}
+
+void check_archive_fs(QString const &work_dir)
+{
+    QString const source = work_dir + "/fs_source";
+    QString const archive = work_dir + "/fs.qtea";
+    make_folder(source);
+    cp::folder_compressor compressor;
+    compressor.set_solid_block_size(64 * 1024);
+    compressor.compress_folder(source, archive);
+
+    cp::archive_fs fs;
+    check(fs.open(archive), "archive fs open");
+    check(fs.entry_list("/") == QStringList({"a.txt", "copy_of_a.txt", "empty.txt", "sub"}) &&
+          fs.is_dir("/sub/deep") && fs.exists("sub/deep/c.txt") && !fs.exists("/missing.txt"),
+          "archive fs list");
+    bool same = true;
+    for(QString const name : {"/a.txt", "/empty.txt", "/sub/b.bin", "/sub/deep/c.txt"}){
+        auto file = fs.open_file(name);
+        same = same && file && file->readAll() == read_file(source + name);
+    }
+    check(same && !fs.open_file("/missing.txt"), "archive fs read");
+}
+
+using task_ptr = std::shared_ptr<net::download_supervisor::download_task>;
+
+//Run the event loop until every task of the supervisor finish, give up
+//after one minute
+bool wait_idle(net::download_supervisor &supervisor)
+{
+    QEventLoop loop;
+    QObject::connect(&supervisor, &net::download_supervisor::all_download_finished,
+                     &loop, [&loop](){ loop.exit(0); });
+    QTimer::singleShot(60 * 1000, &loop, [&loop](){ loop.exit(1); });
+
+    return loop.exec() == 0;
+}
+
+//Download the paths of the server at the host, the tasks are in the
+//order they finish
+bool run_downloads(net::download_supervisor &supervisor, check::local_server const &server,
+                   QString const &host, QStringList const &paths,
+                   QString const &save_at, std::vector<task_ptr> &tasks)
+{
+    QObject context;
+    QObject::connect(&supervisor, &net::download_supervisor::download_finished,
+                     &context, [&tasks](task_ptr task){ tasks.push_back(task); });
+    std::vector<size_t> ids;
+    for(auto const &path : paths){
+        QUrl const url(QString("http://%1:%2%3").arg(host).arg(server.port()).arg(path));
+        ids.push_back(supervisor.append(QNetworkRequest(url), save_at));
+    }
+    for(auto const id : ids){
+        supervisor.start_download_task(id);
+    }
+
+    return wait_idle(supervisor) && tasks.size() == paths.size();
+}
+
+bool downloaded(task_ptr const &task, QByteArray const &data)
+{
+    return task->get_state() == net::download_supervisor::task_state::done &&
+            read_file(task->get_save_as()) == data;
+}
+
+void check_download(QString const &work_dir)
+{
+    check::local_server server;
+    if(!server.listen()){
+        check(false, "download server listen");
+        return;
+    }
+    QString const save_at = work_dir + "/download";
+    QDir().mkpath(save_at);
+    QByteArray const small = make_data(30, 256 * 1024);
+    QByteArray const large = make_data(31, 3 * 1024 * 1024);
+    server.add_resource("/small.bin", small);
+    server.add_resource("/large.bin", large);
+
+    {
+        net::download_supervisor supervisor;
+        std::vector<task_ptr> tasks;
+        check(run_downloads(supervisor, server, "127.0.0.1", {"/small.bin"}, save_at, tasks) &&
+              downloaded(tasks[0], small), "download round trip");
+    }
+
+    //every host download one file at a time, the two hosts overlap
+    {
+        server.set_chunk_delay(20);
+        server.reset_statistics();
+        net::download_supervisor supervisor;
+        supervisor.set_max_download_file(4);
+        supervisor.set_max_download_per_host(1);
+        QObject context;
+        std::vector<task_ptr> tasks;
+        QObject::connect(&supervisor, &net::download_supervisor::download_finished,
+                         &context, [&tasks](task_ptr task){ tasks.push_back(task); });
+        for(auto const &host : {QString("127.0.0.1"), QString("localhost")}){
+            for(int i = 0; i != 3; ++i){
+                QUrl const url(QString("http://%1:%2/small.bin").arg(host).arg(server.port()));
+                supervisor.start_download_task(supervisor.append(QNetworkRequest(url), save_at));
+            }
+        }
+        bool const finished = wait_idle(supervisor) && tasks.size() == 6;
+        bool all_downloaded = finished;
+        for(auto const &task : tasks){
+            all_downloaded = all_downloaded && downloaded(task, small);
+        }
+        check(all_downloaded && server.max_concurrent("127.0.0.1") == 1 &&
+              server.max_concurrent("localhost") == 1 && server.max_concurrent() == 2,
+              "download limit per host");
+        server.set_chunk_delay(0);
+    }
+
+    //the large file is split into ranges downloaded in parallel
+    {
+        server.reset_statistics();
+        net::download_supervisor supervisor;
+        supervisor.set_max_segments(3);
+        std::vector<task_ptr> tasks;
+        bool const finished = run_downloads(supervisor, server, "127.0.0.1", {"/large.bin"},
+                                            save_at, tasks);
+        QRegularExpression const bounded("^bytes=\\d+-\\d+$");
+        auto const &ranges = server.ranges();
+        auto const segments = std::count_if(std::begin(ranges), std::end(ranges),
+                                            [&bounded](QByteArray const &range)
+        {
+            return bounded.match(QString::fromLatin1(range)).hasMatch();
+        });
+        check(finished && downloaded(tasks[0], large) && segments == 3, "download segments");
+    }
+
+    //at most 512KB per second after the burst of 64KB
+    {
+        net::download_supervisor supervisor;
+        supervisor.set_bandwidth(512 * 1024, 64 * 1024);
+        QByteArray const throttled = make_data(32, 512 * 1024);
+        server.add_resource("/throttled.bin", throttled);
+        QElapsedTimer timer;
+        timer.start();
+        std::vector<task_ptr> tasks;
+        bool const finished = run_downloads(supervisor, server, "127.0.0.1",
+                                            {"/throttled.bin"}, save_at, tasks);
+        check(finished && downloaded(tasks[0], throttled) &&
+              timer.elapsed() >= 700, "download bandwidth limit");
+    }
+
+    //the broken download continue from the end of the partial file
+    {
+        server.reset_statistics();
+        server.add_resource("/broken.bin", large);
+        server.break_after("/broken.bin", 300 * 1024);
+        net::download_supervisor supervisor;
+        supervisor.set_max_resume_attempts(1);
+        std::vector<task_ptr> tasks;
+        bool const finished = run_downloads(supervisor, server, "127.0.0.1", {"/broken.bin"},
+                                            save_at, tasks);
+        auto const &ranges = server.ranges();
+        check(finished && downloaded(tasks[0], large) && ranges.size() == 1 &&
+              ranges[0].startsWith("bytes=") && !ranges[0].startsWith("bytes=0-") &&
+              ranges[0].endsWith("-"), "download resume automatically");
+    }
+
+    //the failed task is resumed by the caller, the done task is not
+    {
+        server.add_resource("/failed.bin", small);
+        server.break_after("/failed.bin", 100 * 1024);
+        net::download_supervisor supervisor;
+        QObject context;
+        std::vector<task_ptr> tasks;
+        QObject::connect(&supervisor, &net::download_supervisor::download_finished, &context,
+                         [&supervisor, &tasks](task_ptr task)
+        {
+            tasks.push_back(task);
+            if(task->get_state() == net::download_supervisor::task_state::failed){
+                supervisor.start_download_task(supervisor.resume(task));
+            }
+        });
+        QUrl const url(QString("http://127.0.0.1:%1/failed.bin").arg(server.port()));
+        supervisor.start_download_task(supervisor.append(QNetworkRequest(url), save_at));
+        bool const finished = wait_idle(supervisor) && tasks.size() == 2;
+        bool const resumed = finished && downloaded(tasks[1], small);
+        if(resumed){
+            supervisor.resume(tasks[1]);
+        }
+        check(resumed && tasks[1]->get_state() == net::download_supervisor::task_state::done,
+              "download resume by caller");
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("qte_selfcheck");
+
+    QTemporaryDir work_dir;
+    if(!work_dir.isValid()){
+        QTextStream(stdout)<<"cannot create the work folder"<<Qt::endl;
+        return -1;
+    }
+
+    check_stream(work_dir.path());
+    check_adaptive_level(work_dir.path());
+    check_device();
+    check_archive(work_dir.path());
+    check_legacy_archive(work_dir.path());
+    check_solid(work_dir.path());
+    check_incremental(work_dir.path());
+    check_deduplicate(work_dir.path());
+    check_verify(work_dir.path());
+    check_job(work_dir.path());
+    check_append(work_dir.path());
+    check_append_version6(work_dir.path());
+    check_exclude(work_dir.path());
+    check_sync(work_dir.path());
+    check_archive_fs(work_dir.path());
+    check_download(work_dir.path());
+
+    QTextStream(stdout)<<failures<<" checks failed"<<Qt::endl;
+
+    return failures == 0 ? 0 : -1;
+}
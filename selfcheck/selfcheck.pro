@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Self check of the compressor module, round trip the stream and
+# archive formats and read the old formats. download_supervisor is
+# checked against a HTTP server on the local machine
+# usage : qte_selfcheck, return 0 if every check pass. It is run by
+# "make check" of qt_enhance_tools.pro
+#
+#-------------------------------------------------
+
+QT       += core concurrent network
+QT       -= gui
+
+TARGET = qte_selfcheck
+TEMPLATE = app
+CONFIG += console c++14 testcase
+CONFIG -= app_bundle
+
+include(../compressor/compressor.pri)
+include(../network/download_supervisor.pri)
+
+SOURCES += main.cpp \
+    local_server.cpp
+
+HEADERS += local_server.hpp